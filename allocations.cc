@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#include <new>
+
+#include <cstdlib>
+
+#include <stdint.h>
+
+/*
+ * Counts heap allocations for the tests. It lives in its own translation
+ * unit so the compiler never inlines these deletes next to the news they
+ * pair with, where it would take free for a mismatched deallocation.
+ */
+uint32_t allocations = 0;
+
+void * operator new (size_t s) {
+  ++allocations;
+  void * const p = malloc(s);
+  if (p == NULL) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void * operator new (size_t s, const std::nothrow_t &) throw () {
+  ++allocations;
+  return malloc(s);
+}
+
+void operator delete (void * p) throw () {
+  free(p);
+}
+
+void operator delete (void * p, size_t) throw () {
+  free(p);
+}
+
+void operator delete (void * p, const std::nothrow_t &) throw () {
+  free(p);
+}
+
+void * operator new [] (size_t s) {
+  return operator new (s);
+}
+
+void * operator new [] (size_t s, const std::nothrow_t & n) throw () {
+  return operator new (s, n);
+}
+
+void operator delete [] (void * p) throw () {
+  free(p);
+}
+
+void operator delete [] (void * p, size_t) throw () {
+  free(p);
+}
+
+void operator delete [] (void * p, const std::nothrow_t &) throw () {
+  free(p);
+}
@@ -11,23 +11,15 @@
 #include "my-assert.h"
 
 #include "assembler.h"
+#include "hash-set.h"
 #include "opcodes.h"
 
 namespace http {
 namespace filters {
 
-struct MapFinder {
-  const char * const key_;
-  MapFinder(const char * const k) : key_(k) { }
-  bool operator ()(const Labels::value_type & v) const {
-    return strcmp(v.first.c_str(), key_) == 0;
-  }
-};
-
 uint32_t Assembler::operator [](const char * const l) const {
   ASSERT(l != NULL);
-  const Labels::const_iterator E = labels_.end(),
-        it = std::find_if(labels_.begin(), E, MapFinder(l));
+  const Labels::const_iterator E = labels_.end(), it = labels_.find(l);
   if (it == E) {
     return -1;
   }
@@ -51,24 +43,151 @@ void Assembler::push(const uint32_t op, const uint32_t a,
 }
 
 uint32_t Assembler::pushMemory(const char * const a) {
-  typedef std::pair< Labels::iterator, bool > Result;
   ASSERT(a != NULL);
   
   if ('\0' == *a) {
     return 0;
   }
-  
-  Result result = memoryUnifier_.insert(
-      std::make_pair(std::string(a), instructions_.size()));
 
-  if (result.second) {
-    const size_t l = strlen(a) + 1;
-    result.first->second = std::distance(memory_.begin(), memory_.end());
-    std::copy(a, a + l, std::back_inserter(memory_));
+  const uint32_t l = strlen(a), h = HashSet::Hash(a, l);
+  uint32_t o = memoryUnifier_.find(memory_, a, l, h);
+
+  if (o == 0) {
+    o = memory_.size();
+    std::copy(a, a + l + 1, std::back_inserter(memory_));
+    memoryUnifier_.insert(h, o);
   }
 
-  ASSERT(result.first->second <= memory_.size());
-  return result.first->second;
+  ASSERT(o < memory_.size());
+  return o;
+}
+
+//a string searched for, after its table when it has one, see Needle.
+uint32_t Assembler::pushNeedle(const char * const a) {
+  ASSERT(a != NULL);
+
+  const uint32_t l = strlen(a);
+  if (l < Needle::kShortest) {
+    return pushMemory(a);
+  }
+
+  const uint32_t h = HashSet::Hash(a, l);
+  uint32_t o = needleUnifier_.find(memory_, a, l, h);
+
+  if (o == 0) {
+    const uint32_t t = memory_.size();
+    memory_.resize(t + Needle::kTable + l + 1, '\0');
+    Needle::Build(a, l, reinterpret_cast< uint8_t * >(&memory_[t]));
+    std::copy(a, a + l, memory_.begin() + t + Needle::kTable);
+    o = t + Needle::kTable;
+    needleUnifier_.insert(h, o);
+  }
+
+  ASSERT(o < memory_.size());
+  return o;
+}
+
+//word aligned and never unified, for tables like Automaton.
+uint32_t Assembler::pushBlob(const std::vector< uint32_t > & a) {
+  ASSERT( ! a.empty());
+  while (memory_.size() % sizeof(uint32_t) != 0) {
+    memory_.push_back('\0');
+  }
+  const uint32_t o = memory_.size();
+  const char * const p = reinterpret_cast< const char * >(&a[0]);
+  std::copy(p, p + a.size() * sizeof(uint32_t), std::back_inserter(memory_));
+  blobs_[o] = a.size();
+  return o;
+}
+
+/*
+ * Rebuilds memory out of what the code still refers to, pushing it again
+ * in code order, and rewrites the operands.
+ */
+void Assembler::compactMemory(void) {
+  RawMemory old;
+  old.swap(memory_);
+  memory_.push_back('\0');
+  memoryUnifier_.clear();
+  needleUnifier_.clear();
+  Blobs blobs;
+  blobs.swap(blobs_);
+
+  Blobs moves;
+  const Instructions::iterator END = instructions_.end();
+  for (Instructions::iterator it = instructions_.begin(); it != END; ++it) {
+    const Operands o = Operands::Of(it->op);
+    //the comment of a kSkip is only read by the printer.
+    const uint8_t a = it->op == Opcodes::kSkip
+      ? static_cast< uint8_t >(Operands::kMemory) : o.a;
+    it->a = relocate(old, blobs, moves, it->a, a);
+    it->b = relocate(old, blobs, moves, it->b, o.b);
+  }
+}
+
+uint32_t Assembler::relocate(const RawMemory & m, const Blobs & b,
+    Blobs & moves, const uint32_t o, const uint8_t k) {
+  if ((k != Operands::kMemory && k != Operands::kNeedle
+        && k != Operands::kBlob) || o == 0) {
+    return o;
+  }
+  const Blobs::const_iterator it = moves.find(o);
+  if (it != moves.end()) {
+    return it->second;
+  }
+
+  ASSERT(o < m.size());
+  uint32_t r = 0;
+  if (k == Operands::kBlob) {
+    const Blobs::const_iterator blob = b.find(o);
+    ASSERT(blob != b.end());
+    std::vector< uint32_t > a(blob->second);
+    memcpy(&a[0], &m[o], a.size() * sizeof(uint32_t));
+    r = pushBlob(a);
+  } else if (k == Operands::kNeedle) {
+    r = pushNeedle(&m[o]);
+  } else {
+    r = pushMemory(&m[o]);
+  }
+  moves[o] = r;
+  return r;
+}
+
+void Assembler::pushContainsMany(const Opcodes::OPCODES op,
+    const char * const a, const uint32_t b, const uint32_t c) {
+  if (op != Opcodes::kContainsManyDomain
+      && op != Opcodes::kContainsManyPath
+      && op != Opcodes::kContainsManyQueryParameter
+      && op != Opcodes::kContainsManyHeader
+      && op != Opcodes::kContainsManyCookie) {
+    throw std::invalid_argument("Invalid opcode");
+  }
+  if (b == 0 || b % sizeof(uint32_t) != 0 || b >= memory_.size()) {
+    throw std::invalid_argument("Invalid 2nd argument: not an automaton");
+  }
+  uint32_t o = 0;
+  if (a != NULL) {
+    o = op == Opcodes::kContainsManyHeader ? pushFolded(a) : pushMemory(a);
+  }
+  push(op, o, b, c);
+}
+
+void Assembler::pushEqualSet(const Opcodes::OPCODES op, const uint32_t a) {
+  if (op != Opcodes::kEqualDomainSet && op != Opcodes::kEqualPathSet) {
+    throw std::invalid_argument("Invalid opcode");
+  }
+  if (a % sizeof(uint32_t) != 0 || a >= memory_.size()) {
+    throw std::invalid_argument("Invalid 1st argument: not a hash set");
+  }
+  push(op, a, 0, 0);
+}
+
+void Assembler::pushMatches(const std::vector< uint32_t > & a) {
+  std::vector< uint32_t > b;
+  b.reserve(a.size() + 1);
+  b.push_back(a.size());
+  b.insert(b.end(), a.begin(), a.end());
+  push(Opcodes::kMatches, pushBlob(b), 0, 0);
 }
 
 void Assembler::pushPrintDebug(const char * const a,
@@ -78,7 +197,7 @@ void Assembler::pushPrintDebug(const char * const a,
   }
   const uint32_t o = pushMemory(a);
   const uint32_t p = b != NULL ? pushMemory(b) : 0;
-  push(Opcodes::kPrintDebug, o, 0, 0);
+  push(Opcodes::kPrintDebug, o, p, c);
 }
 
 void Assembler::pushPrintError(const char * const a,
@@ -100,11 +219,18 @@ void Assembler::pushExecute(const ExecutionMode::MODES m,
   push(Opcodes::kExecute, m, o, c);
 }
 
+//refers to an already emitted kExecute, sharing its block and its result.
+void Assembler::pushExecuteSingle(const uint32_t a) {
+  ASSERT(a < codeSize());
+  ASSERT(instructions_[a].op == Opcodes::kExecute);
+  push(Opcodes::kExecuteSingle, a, 0, 0);
+}
+
 void Assembler::pushExistsHeader(const char * const a) {
   if (a == NULL) {
     throw std::invalid_argument("Invalid 1st argument: NULL pointer");
   }
-  const uint32_t o = pushMemory(a);
+  const uint32_t o = pushFolded(a);
   push(Opcodes::kExistsHeader, o, 0, 0);
 }
 
@@ -112,7 +238,7 @@ void Assembler::pushEqualHeader(const char * const a, const char * const b) {
   if (a == NULL) {
     throw std::invalid_argument("Invalid 1st argument: NULL pointer");
   }
-  const uint32_t o = pushMemory(a),
+  const uint32_t o = pushFolded(a),
         p = pushMemory(b);
   push(Opcodes::kEqualHeader, o, p, 0);
 }
@@ -130,7 +256,7 @@ void Assembler::pushGreaterThanHeader(const char * const a, const uint32_t b) {
   if (a == NULL) {
     throw std::invalid_argument("Invalid 1st argument: NULL pointer");
   }
-  const uint32_t o = pushMemory(a);
+  const uint32_t o = pushFolded(a);
   push(Opcodes::kGreaterThanHeader, o, b, 0);
 }
 
@@ -138,7 +264,7 @@ void Assembler::pushLessThanHeader(const char * const a, const uint32_t b) {
   if (a == NULL) {
     throw std::invalid_argument("Invalid 1st argument: NULL pointer");
   }
-  const uint32_t o = pushMemory(a);
+  const uint32_t o = pushFolded(a);
   push(Opcodes::kLessThanHeader, o, b, 0);
 }
 
@@ -168,7 +294,7 @@ void Assembler::pushContainsDomain(const char * const a, const uint32_t b) {
   } else if (strlen(a) < b) {
     throw std::invalid_argument("Invalid 2st argument: greater than string");
   }
-  const uint32_t o = pushMemory(a);
+  const uint32_t o = pushNeedle(a);
   push(Opcodes::kContainsDomain, o, b, 0);
 }
 
@@ -199,7 +325,7 @@ void Assembler::pushStartsWithDomain(const char * const a, const uint32_t b,
   } else if (strlen(a) < b) {
     throw std::invalid_argument("Invalid 2st argument: greater than string");
   }
-  const uint32_t o = pushMemory(a);
+  const uint32_t o = pushNeedle(a);
   push(Opcodes::kStartsWithDomain, o, b, c);
 }
 
@@ -209,7 +335,7 @@ void Assembler::pushContainsPath(const char * const a, const uint32_t b) {
   } else if (strlen(a) < b) {
     throw std::invalid_argument("Invalid 2st argument: greater than string");
   }
-  const uint32_t o = pushMemory(a);
+  const uint32_t o = pushNeedle(a);
   push(Opcodes::kContainsPath, o, b, 0);
 }
 
@@ -230,7 +356,7 @@ void Assembler::pushStartsWithPath(const char * const a, const uint32_t b,
   } else if (strlen(a) < b) {
     throw std::invalid_argument("Invalid 2st argument: greater than string");
   }
-  const uint32_t o = pushMemory(a);
+  const uint32_t o = pushNeedle(a);
   push(Opcodes::kStartsWithPath, o, b, c);
 }
 
@@ -252,7 +378,7 @@ void Assembler::pushContainsQueryParameter(
     throw std::invalid_argument("Invalid 2st argument: NULL pointer");
   }
   const uint32_t o = pushMemory(a),
-        p = pushMemory(b);
+        p = pushNeedle(b);
   push(Opcodes::kContainsQueryParameter, o, p, 0);
 }
 
@@ -263,7 +389,7 @@ void Assembler::pushContainsCookie(const char * const a, const char * const b) {
     throw std::invalid_argument("Invalid 2st argument: NULL pointer");
   }
   const uint32_t o = pushMemory(a),
-        p = pushMemory(b);
+        p = pushNeedle(b);
   push(Opcodes::kContainsCookie, o, p, 0);
 }
 
@@ -274,8 +400,8 @@ void Assembler::pushContainsHeader(const char * const a, const char * const b) {
   } else if (b == NULL) {
     throw std::invalid_argument("Invalid 2st argument: NULL pointer");
   }
-  const uint32_t o = pushMemory(a),
-        p = pushMemory(b);
+  const uint32_t o = pushFolded(a),
+        p = pushNeedle(b);
   push(Opcodes::kContainsHeader, o, p, 0);
 }
 
@@ -286,8 +412,8 @@ void Assembler::pushGreaterThanAfterHeader(const char * const a,
   } else if (b == NULL) {
     throw std::invalid_argument("Invalid 2st argument: NULL pointer");
   }
-  const uint32_t o = pushMemory(a),
-        p = pushMemory(b);
+  const uint32_t o = pushFolded(a),
+        p = pushNeedle(b);
   push(Opcodes::kGreaterThanAfterHeader, o, p, c);
 }
 
@@ -298,8 +424,8 @@ void Assembler::pushLessThanAfterHeader(const char * const a,
   } else if (b == NULL) {
     throw std::invalid_argument("Invalid 2st argument: NULL pointer");
   }
-  const uint32_t o = pushMemory(a),
-        p = pushMemory(b);
+  const uint32_t o = pushFolded(a),
+        p = pushNeedle(b);
   push(Opcodes::kLessThanAfterHeader, o, p, c);
 }
 
@@ -311,7 +437,7 @@ void Assembler::pushGreaterThanAfterQueryParameter(const char * const a,
     throw std::invalid_argument("Invalid 2st argument: NULL pointer");
   }
   const uint32_t o = pushMemory(a),
-        p = pushMemory(b);
+        p = pushNeedle(b);
   push(Opcodes::kGreaterThanAfterQueryParameter, o, p, c);
 }
 
@@ -323,7 +449,7 @@ void Assembler::pushLessThanAfterQueryParameter(const char * const a,
     throw std::invalid_argument("Invalid 2st argument: NULL pointer");
   }
   const uint32_t o = pushMemory(a),
-        p = pushMemory(b);
+        p = pushNeedle(b);
   push(Opcodes::kLessThanAfterQueryParameter, o, p, c);
 }
 
@@ -335,7 +461,7 @@ void Assembler::pushGreaterThanAfterCookie(const char * const a,
     throw std::invalid_argument("Invalid 2st argument: NULL pointer");
   }
   const uint32_t o = pushMemory(a),
-        p = pushMemory(b);
+        p = pushNeedle(b);
   push(Opcodes::kGreaterThanAfterCookie, o, p, c);
 }
 
@@ -347,7 +473,7 @@ void Assembler::pushLessThanAfterCookie(const char * const a,
     throw std::invalid_argument("Invalid 2st argument: NULL pointer");
   }
   const uint32_t o = pushMemory(a),
-        p = pushMemory(b);
+        p = pushNeedle(b);
   push(Opcodes::kLessThanAfterCookie, o, p, c);
 }
 
@@ -375,7 +501,7 @@ void Assembler::pushGreaterThanCookie(const char * const a,
     throw std::invalid_argument("Invalid 1st argument: NULL pointer");
   }
   const uint32_t o = pushMemory(a);
-  push(Opcodes::kGreaterThanAfterCookie, o, b, 0);
+  push(Opcodes::kGreaterThanCookie, o, b, 0);
 }
 
 void Assembler::pushLessThanCookie(const char * const a,
@@ -384,7 +510,7 @@ void Assembler::pushLessThanCookie(const char * const a,
     throw std::invalid_argument("Invalid 1st argument: NULL pointer");
   }
   const uint32_t o = pushMemory(a);
-  push(Opcodes::kLessThanAfterCookie, o, b, 0);
+  push(Opcodes::kLessThanCookie, o, b, 0);
 }
 
 void Assembler::pushEqualQueryParameter(const char * const a,
@@ -407,7 +533,7 @@ void Assembler::pushStartsWithQueryParameter(const char * const a,
     throw std::invalid_argument("Invalid 2st argument: NULL pointer");
   }
   const uint32_t o = pushMemory(a),
-        p = pushMemory(b);
+        p = pushNeedle(b);
   push(Opcodes::kStartsWithQueryParameter, o, p, c);
 }
 
@@ -420,7 +546,7 @@ void Assembler::pushNotEqualQueryParameter(const char * const a,
   }
   const uint32_t o = pushMemory(a),
         p = pushMemory(b);
-  push(Opcodes::kNotEqualHeader, o, p, 0);
+  push(Opcodes::kNotEqualQueryParameter, o, p, 0);
 }
 
 void Assembler::pushNotEqualHeader(const char * const a,
@@ -430,7 +556,7 @@ void Assembler::pushNotEqualHeader(const char * const a,
   } else if (b == NULL) {
     throw std::invalid_argument("Invalid 2st argument: NULL pointer");
   }
-  const uint32_t o = pushMemory(a),
+  const uint32_t o = pushFolded(a),
         p = pushMemory(b);
   push(Opcodes::kNotEqualHeader, o, p, 0);
 }
@@ -442,11 +568,47 @@ void Assembler::pushStartsWithHeader(const char * const a,
   } else if (b == NULL) {
     throw std::invalid_argument("Invalid 2st argument: NULL pointer");
   }
-  const uint32_t o = pushMemory(a),
-        p = pushMemory(b);
+  const uint32_t o = pushFolded(a),
+        p = pushNeedle(b);
   push(Opcodes::kStartsWithHeader, o, p, c);
 }
 
+void Assembler::pushContainsHeaderI(const char * const a,
+    const char * const b) {
+  if (a == NULL) {
+    throw std::invalid_argument("Invalid 1st argument: NULL pointer");
+  } else if (b == NULL) {
+    throw std::invalid_argument("Invalid 2st argument: NULL pointer");
+  }
+  const uint32_t o = pushFolded(a),
+        p = pushNeedle(util::Fold(std::string(b)).c_str());
+  push(Opcodes::kContainsHeaderI, o, p, 0);
+}
+
+void Assembler::pushEqualHeaderI(const char * const a,
+    const char * const b) {
+  if (a == NULL) {
+    throw std::invalid_argument("Invalid 1st argument: NULL pointer");
+  } else if (b == NULL) {
+    throw std::invalid_argument("Invalid 2st argument: NULL pointer");
+  }
+  const uint32_t o = pushFolded(a),
+        p = pushFolded(b);
+  push(Opcodes::kEqualHeaderI, o, p, 0);
+}
+
+void Assembler::pushNotEqualHeaderI(const char * const a,
+    const char * const b) {
+  if (a == NULL) {
+    throw std::invalid_argument("Invalid 1st argument: NULL pointer");
+  } else if (b == NULL) {
+    throw std::invalid_argument("Invalid 2st argument: NULL pointer");
+  }
+  const uint32_t o = pushFolded(a),
+        p = pushFolded(b);
+  push(Opcodes::kNotEqualHeaderI, o, p, 0);
+}
+
 void Assembler::pushNotEqualCookie(const char * const a,
     const char * const b) {
   if (a == NULL) {
@@ -456,7 +618,7 @@ void Assembler::pushNotEqualCookie(const char * const a,
   }
   const uint32_t o = pushMemory(a),
         p = pushMemory(b);
-  push(Opcodes::kNotEqualHeader, o, p, 0);
+  push(Opcodes::kNotEqualCookie, o, p, 0);
 }
 
 void Assembler::pushExistsQueryParameter(const char * const a) {
@@ -475,5 +637,197 @@ void Assembler::pushExistsCookie(const char * const a) {
   push(Opcodes::kExistsCookie, o, 0, 0);
 }
 
+void Assembler::pushExistsContainsQueryParameter(const char * const a,
+    const char * const b, const ExecutionMode::MODES c) {
+  if (a == NULL) {
+    throw std::invalid_argument("Invalid 1st argument: NULL pointer");
+  } else if (b == NULL) {
+    throw std::invalid_argument("Invalid 2st argument: NULL pointer");
+  }
+  ASSERT(c == ExecutionMode::kNone
+      || c == ExecutionMode::kAnd
+      || c == ExecutionMode::kOr);
+  const uint32_t o = pushMemory(a),
+        p = pushNeedle(b);
+  push(Opcodes::kExistsContainsQueryParameter, o, p, c);
+}
+
+void Assembler::pushExistsEqualQueryParameter(const char * const a,
+    const char * const b, const ExecutionMode::MODES c) {
+  if (a == NULL) {
+    throw std::invalid_argument("Invalid 1st argument: NULL pointer");
+  } else if (b == NULL) {
+    throw std::invalid_argument("Invalid 2st argument: NULL pointer");
+  }
+  ASSERT(c == ExecutionMode::kNone
+      || c == ExecutionMode::kAnd
+      || c == ExecutionMode::kOr);
+  const uint32_t o = pushMemory(a),
+        p = pushMemory(b);
+  push(Opcodes::kExistsEqualQueryParameter, o, p, c);
+}
+
+void Assembler::pushExistsGreaterThanQueryParameter(const char * const a,
+    const uint32_t b, const ExecutionMode::MODES c) {
+  if (a == NULL) {
+    throw std::invalid_argument("Invalid 1st argument: NULL pointer");
+  }
+  ASSERT(c == ExecutionMode::kNone
+      || c == ExecutionMode::kAnd
+      || c == ExecutionMode::kOr);
+  const uint32_t o = pushMemory(a);
+  push(Opcodes::kExistsGreaterThanQueryParameter, o, b, c);
+}
+
+void Assembler::pushExistsLessThanQueryParameter(const char * const a,
+    const uint32_t b, const ExecutionMode::MODES c) {
+  if (a == NULL) {
+    throw std::invalid_argument("Invalid 1st argument: NULL pointer");
+  }
+  ASSERT(c == ExecutionMode::kNone
+      || c == ExecutionMode::kAnd
+      || c == ExecutionMode::kOr);
+  const uint32_t o = pushMemory(a);
+  push(Opcodes::kExistsLessThanQueryParameter, o, b, c);
+}
+
+void Assembler::pushExistsStartsWithQueryParameter(const char * const a,
+    const char * const b, const ExecutionMode::MODES c) {
+  if (a == NULL) {
+    throw std::invalid_argument("Invalid 1st argument: NULL pointer");
+  } else if (b == NULL) {
+    throw std::invalid_argument("Invalid 2st argument: NULL pointer");
+  }
+  ASSERT(c == ExecutionMode::kNone
+      || c == ExecutionMode::kAnd
+      || c == ExecutionMode::kOr);
+  const uint32_t o = pushMemory(a),
+        p = pushNeedle(b);
+  push(Opcodes::kExistsStartsWithQueryParameter, o, p, c);
+}
+
+void Assembler::pushExistsContainsHeader(const char * const a,
+    const char * const b, const ExecutionMode::MODES c) {
+  if (a == NULL) {
+    throw std::invalid_argument("Invalid 1st argument: NULL pointer");
+  } else if (b == NULL) {
+    throw std::invalid_argument("Invalid 2st argument: NULL pointer");
+  }
+  ASSERT(c == ExecutionMode::kNone
+      || c == ExecutionMode::kAnd
+      || c == ExecutionMode::kOr);
+  const uint32_t o = pushFolded(a),
+        p = pushNeedle(b);
+  push(Opcodes::kExistsContainsHeader, o, p, c);
+}
+
+void Assembler::pushExistsEqualHeader(const char * const a,
+    const char * const b, const ExecutionMode::MODES c) {
+  if (a == NULL) {
+    throw std::invalid_argument("Invalid 1st argument: NULL pointer");
+  } else if (b == NULL) {
+    throw std::invalid_argument("Invalid 2st argument: NULL pointer");
+  }
+  ASSERT(c == ExecutionMode::kNone
+      || c == ExecutionMode::kAnd
+      || c == ExecutionMode::kOr);
+  const uint32_t o = pushFolded(a),
+        p = pushMemory(b);
+  push(Opcodes::kExistsEqualHeader, o, p, c);
+}
+
+void Assembler::pushExistsGreaterThanHeader(const char * const a,
+    const uint32_t b, const ExecutionMode::MODES c) {
+  if (a == NULL) {
+    throw std::invalid_argument("Invalid 1st argument: NULL pointer");
+  }
+  ASSERT(c == ExecutionMode::kNone
+      || c == ExecutionMode::kAnd
+      || c == ExecutionMode::kOr);
+  const uint32_t o = pushFolded(a);
+  push(Opcodes::kExistsGreaterThanHeader, o, b, c);
+}
+
+void Assembler::pushExistsLessThanHeader(const char * const a,
+    const uint32_t b, const ExecutionMode::MODES c) {
+  if (a == NULL) {
+    throw std::invalid_argument("Invalid 1st argument: NULL pointer");
+  }
+  ASSERT(c == ExecutionMode::kNone
+      || c == ExecutionMode::kAnd
+      || c == ExecutionMode::kOr);
+  const uint32_t o = pushFolded(a);
+  push(Opcodes::kExistsLessThanHeader, o, b, c);
+}
+
+void Assembler::pushExistsStartsWithHeader(const char * const a,
+    const char * const b, const ExecutionMode::MODES c) {
+  if (a == NULL) {
+    throw std::invalid_argument("Invalid 1st argument: NULL pointer");
+  } else if (b == NULL) {
+    throw std::invalid_argument("Invalid 2st argument: NULL pointer");
+  }
+  ASSERT(c == ExecutionMode::kNone
+      || c == ExecutionMode::kAnd
+      || c == ExecutionMode::kOr);
+  const uint32_t o = pushFolded(a),
+        p = pushNeedle(b);
+  push(Opcodes::kExistsStartsWithHeader, o, p, c);
+}
+
+void Assembler::pushExistsContainsCookie(const char * const a,
+    const char * const b, const ExecutionMode::MODES c) {
+  if (a == NULL) {
+    throw std::invalid_argument("Invalid 1st argument: NULL pointer");
+  } else if (b == NULL) {
+    throw std::invalid_argument("Invalid 2st argument: NULL pointer");
+  }
+  ASSERT(c == ExecutionMode::kNone
+      || c == ExecutionMode::kAnd
+      || c == ExecutionMode::kOr);
+  const uint32_t o = pushMemory(a),
+        p = pushNeedle(b);
+  push(Opcodes::kExistsContainsCookie, o, p, c);
+}
+
+void Assembler::pushExistsEqualCookie(const char * const a,
+    const char * const b, const ExecutionMode::MODES c) {
+  if (a == NULL) {
+    throw std::invalid_argument("Invalid 1st argument: NULL pointer");
+  } else if (b == NULL) {
+    throw std::invalid_argument("Invalid 2st argument: NULL pointer");
+  }
+  ASSERT(c == ExecutionMode::kNone
+      || c == ExecutionMode::kAnd
+      || c == ExecutionMode::kOr);
+  const uint32_t o = pushMemory(a),
+        p = pushMemory(b);
+  push(Opcodes::kExistsEqualCookie, o, p, c);
+}
+
+void Assembler::pushExistsGreaterThanCookie(const char * const a,
+    const uint32_t b, const ExecutionMode::MODES c) {
+  if (a == NULL) {
+    throw std::invalid_argument("Invalid 1st argument: NULL pointer");
+  }
+  ASSERT(c == ExecutionMode::kNone
+      || c == ExecutionMode::kAnd
+      || c == ExecutionMode::kOr);
+  const uint32_t o = pushMemory(a);
+  push(Opcodes::kExistsGreaterThanCookie, o, b, c);
+}
+
+void Assembler::pushExistsLessThanCookie(const char * const a,
+    const uint32_t b, const ExecutionMode::MODES c) {
+  if (a == NULL) {
+    throw std::invalid_argument("Invalid 1st argument: NULL pointer");
+  }
+  ASSERT(c == ExecutionMode::kNone
+      || c == ExecutionMode::kAnd
+      || c == ExecutionMode::kOr);
+  const uint32_t o = pushMemory(a);
+  push(Opcodes::kExistsLessThanCookie, o, b, c);
+}
+
 } //end of filters namespace
 } //end of http namespace
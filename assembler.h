@@ -12,6 +12,9 @@
 #include <string>
 #include <vector>
 
+#include "fold.h"
+#include "interner.h"
+#include "needle.h"
 #include "opcodes.h"
 
 #include "vm.h"
@@ -23,11 +26,15 @@ typedef std::map< std::string, uint32_t > Labels;
 struct Assembler {
   typedef std::vector< Instruction > Instructions;
   typedef std::vector< char > RawMemory;
+  typedef std::map< uint32_t, uint32_t > Blobs;
 
   Instructions instructions_;
   RawMemory memory_;
-  Labels memoryUnifier_;
+  Interner memoryUnifier_;
+  Interner needleUnifier_;
   Labels labels_;
+  //the size in words of every blob, by offset.
+  Blobs blobs_;
 
   Assembler(void) {
     memory_.push_back('\0');
@@ -48,6 +55,8 @@ struct Assembler {
   void pushExecute(const ExecutionMode::MODES,
       const uint32_t, const uint32_t c = 0);
 
+  void pushExecuteSingle(const uint32_t);
+
   inline void pushReturn(void) { push(Opcodes::kReturn, 0, 0, 0); }
   inline void pushNone(void) { push(Opcodes::kNone, 0, 0, 0); }
   inline void pushAnd(void) { push(Opcodes::kAnd, 0, 0, 0); }
@@ -55,12 +64,51 @@ struct Assembler {
   inline void pushNot(void) { push(Opcodes::kNot, 0, 0, 0); }
   inline void pushTrue(void) { push(Opcodes::kTrue, 0, 0, 0); }
   inline void pushFalse(void) { push(Opcodes::kFalse, 0, 0, 0); }
+  inline void pushFlip(void) { push(Opcodes::kFlip, 0, 0, 0); }
+
+  inline void pushJump(const uint32_t a) { push(Opcodes::kJump, a, 0, 0); }
+  inline void pushJumpIfTrue(const uint32_t a) {
+    push(Opcodes::kJumpIfTrue, a, 0, 0); }
+  inline void pushJumpIfFalse(const uint32_t a) {
+    push(Opcodes::kJumpIfFalse, a, 0, 0); }
+
+  //sets the target of an already pushed jump.
+  inline void patch(const uint32_t i, const uint32_t a) {
+    ASSERT(i < instructions_.size());
+    ASSERT(instructions_[i].op == Opcodes::kJump
+        || instructions_[i].op == Opcodes::kJumpIfTrue
+        || instructions_[i].op == Opcodes::kJumpIfFalse);
+    instructions_[i].a = a;
+  }
 
   void push(const uint32_t, const uint32_t,
       const uint32_t, const uint32_t);
 
   uint32_t pushMemory(const char * const);
 
+  uint32_t pushNeedle(const char * const);
+
+  //header names, and what the I variants compare, go in lower case.
+  inline uint32_t pushFolded(const char * const a) {
+    ASSERT(a != NULL);
+    return pushMemory(util::Fold(std::string(a)).c_str());
+  }
+
+  uint32_t pushBlob(const std::vector< uint32_t > &);
+
+  //drops what no instruction refers to.
+  void compactMemory(void);
+
+  uint32_t relocate(const RawMemory &, const Blobs &, Blobs &,
+      const uint32_t, const uint8_t);
+
+  void pushContainsMany(const Opcodes::OPCODES, const char * const,
+      const uint32_t, const uint32_t);
+
+  void pushEqualSet(const Opcodes::OPCODES, const uint32_t);
+
+  void pushMatches(const std::vector< uint32_t > &);
+
   void pushPrintDebug(const char * const, const char * const b = NULL,
       const ExecutionMode::MODES c = ExecutionMode::kNone);
 
@@ -71,6 +119,9 @@ struct Assembler {
       reinterpret_cast< Code::Type * >(instructions_.data()),
       instructions_.size() * (sizeof(Instruction) / sizeof(Code::Type))); }
 
+  //the same code in the 8 byte encoding.
+  inline CompactCode compact(void) const { return CompactCode(code()); }
+
   inline Memory memory(void) const {
     return Memory(memory_.data(), memory_.size()); }
 
@@ -149,6 +200,12 @@ struct Assembler {
 
   void pushStartsWithHeader(const char * const, const char * const, const uint32_t);
 
+  void pushContainsHeaderI(const char * const, const char * const);
+
+  void pushEqualHeaderI(const char * const, const char * const);
+
+  void pushNotEqualHeaderI(const char * const, const char * const);
+
   /*
    * Cookies
    */
@@ -169,6 +226,51 @@ struct Assembler {
       const uint32_t);
 
   void pushNotEqualCookie(const char * const, const char * const);
+
+  /*
+   * Fused exists + comparison
+   */
+  void pushExistsContainsQueryParameter(const char * const, const char * const,
+      const ExecutionMode::MODES);
+
+  void pushExistsEqualQueryParameter(const char * const, const char * const,
+      const ExecutionMode::MODES);
+
+  void pushExistsGreaterThanQueryParameter(const char * const, const uint32_t,
+      const ExecutionMode::MODES);
+
+  void pushExistsLessThanQueryParameter(const char * const, const uint32_t,
+      const ExecutionMode::MODES);
+
+  void pushExistsStartsWithQueryParameter(const char * const, const char * const,
+      const ExecutionMode::MODES);
+
+  void pushExistsContainsHeader(const char * const, const char * const,
+      const ExecutionMode::MODES);
+
+  void pushExistsEqualHeader(const char * const, const char * const,
+      const ExecutionMode::MODES);
+
+  void pushExistsGreaterThanHeader(const char * const, const uint32_t,
+      const ExecutionMode::MODES);
+
+  void pushExistsLessThanHeader(const char * const, const uint32_t,
+      const ExecutionMode::MODES);
+
+  void pushExistsStartsWithHeader(const char * const, const char * const,
+      const ExecutionMode::MODES);
+
+  void pushExistsContainsCookie(const char * const, const char * const,
+      const ExecutionMode::MODES);
+
+  void pushExistsEqualCookie(const char * const, const char * const,
+      const ExecutionMode::MODES);
+
+  void pushExistsGreaterThanCookie(const char * const, const uint32_t,
+      const ExecutionMode::MODES);
+
+  void pushExistsLessThanCookie(const char * const, const uint32_t,
+      const ExecutionMode::MODES);
 };
 } //end of filters namespace
 } //end of http namespace
@@ -7,36 +7,141 @@
 #ifndef ATS_FILTERS
 #define ATS_FILTERS
 
+#include <fstream>
 #include <sstream>
+#include <string>
+#include <pthread.h>
 #include <ts/ts.h>
 
 #include "compiler.h"
+#include "image.h"
+#include "profile.h"
 #include "representation.h"
+#include "rules.h"
 #include "ts-impl.h"
 #include "vm-impl.h"
 #include "vm-printer.h"
 
+/*
+ * ENABLE_AOT swaps the VM for the C++ translation of the same rules, see
+ * the aot target in the Makefile.
+ */
+#ifdef ENABLE_AOT
+#include "rules-aot.h"
+#endif
+
 #ifndef PLUGIN_TAG
 #error Please define a PLUGIN_TAG before including this file.
 #endif
 
+/*
+ * the program of every transaction. Compiled on start, or mapped from an
+ * image which then owns code and memory.
+ */
 struct Data {
+  http::filters::Image * const image;
   const http::filters::Code code;
   const http::filters::Memory memory;
+  //decoded once, shared read-only by every transaction.
+  const http::filters::Program program;
   const http::filters::Offsets offsets;
+  //what the entries read, fetched once per transaction.
+  const http::filters::Requirements requirements;
+  //the rules as a single decision diagram, when it fits.
+  const bool diagram;
+  const uint32_t entry;
 
   ~Data() {
-    delete code.t;
-    delete memory.t;
+    if (image != NULL) {
+      delete image;
+      return;
+    }
+    free(const_cast< uint32_t * >(code.t));
+    free(const_cast< char * >(memory.t));
   }
 
   Data(const http::filters::Compiler & c,
-      const http::filters::Offsets & o) :
+      const http::filters::Offsets & o, const bool d, const uint32_t e) :
+    image(NULL),
     code(http::filters::Code::Copy(c.assembler_.code())),
     memory(http::filters::Memory::Copy(c.assembler_.memory())),
-    offsets(o) { }
+    program(code, memory),
+    offsets(o), requirements(c.requirements_), diagram(d), entry(e) { }
+
+  Data(http::filters::Image * const i) :
+    image(i), code(i->code), memory(i->memory), program(code, memory),
+    offsets(i->offsets), requirements(i->requirements),
+    diagram(i->diagram), entry(i->entry) { }
+};
+
+//the name of every entry, from the image when there is one.
+static std::vector< std::string > names;
+
+#ifndef ENABLE_AOT
+typedef http::filters::VM< http::filters::TSImplementation > MyVM;
+
+/*
+ * every thread keeps its own VM and result bits, and reuses them across
+ * transactions.
+ */
+struct Thread {
+  MyVM vm;
+  http::filters::Bitmap results;
+  uint32_t transactions;
+
+  Thread(const http::filters::TSImplementation & i, const Data & d) :
+    vm(i, d.program), results(d.offsets.size()), transactions(0) { }
 };
 
+static pthread_key_t key;
+
+static void destroy(void * t) {
+  delete static_cast< Thread * >(t);
+}
+
+/*
+ * Given --profile and a path the plugin profiles the VM. Every thread
+ * merges its counters into the shared profile every kDump transactions,
+ * and a task thread rewrites the file, off the request path. On start the
+ * rules are ordered by what the file measured, so restarting rebuilds the
+ * program from live traffic.
+ */
+static const uint32_t kDump = 1 << 16;
+static std::string profilePath;
+static http::filters::Profile profile;
+static pthread_mutex_t profileMutex = PTHREAD_MUTEX_INITIALIZER;
+//writes the file, and whether it is already scheduled.
+static TSCont writer = NULL;
+static bool writing = false;
+
+static int writeProfile(TSCont, TSEvent, void *) {
+  std::stringstream ss;
+  pthread_mutex_lock(&profileMutex);
+  profile.write(ss);
+  pthread_mutex_unlock(&profileMutex);
+
+  std::ofstream o(profilePath.c_str());
+  o << ss.str();
+
+  pthread_mutex_lock(&profileMutex);
+  writing = false;
+  pthread_mutex_unlock(&profileMutex);
+  return 0;
+}
+
+static void dump(Thread & t, const Data & d) {
+  pthread_mutex_lock(&profileMutex);
+  profile.add(d.program, t.vm.counters_);
+  const bool schedule = ! writing;
+  writing = true;
+  pthread_mutex_unlock(&profileMutex);
+  t.vm.profile();
+  if (schedule) {
+    TSContSchedule(writer, 0, TS_THREAD_POOL_TASK);
+  }
+}
+#endif
+
 static int handler(TSCont continuation, TSEvent event, void * data) {
   TSHttpTxn transaction = static_cast< TSHttpTxn >(data);
   TSMBuffer buffer;
@@ -46,26 +151,57 @@ static int handler(TSCont continuation, TSEvent event, void * data) {
     {
       using namespace http::filters;
 
+#ifdef ENABLE_AOT
+      TSImplementation implementation(PLUGIN_TAG, buffer, header);
+      Rules< TSImplementation > rules(implementation);
+#else
       Data * data = static_cast< Data * >(TSContDataGet(continuation));
       ASSERT(data != NULL);
 
-      typedef VM< TSImplementation > MyVM;
-      MyVM vm(TSImplementation(PLUGIN_TAG, buffer, header),
-          data->code, data->memory);
+      Thread * thread = static_cast< Thread * >(pthread_getspecific(key));
+      if (thread == NULL) {
+        thread = new Thread(TSImplementation(PLUGIN_TAG, buffer, header),
+            *data);
+        if ( ! profilePath.empty()) {
+          thread->vm.profile();
+        }
+        pthread_setspecific(key, thread);
+      } else {
+        thread->vm.reset(TSImplementation(PLUGIN_TAG, buffer, header));
+      }
 
-      const char * names[] = {
-        "http get", "firefox", "yahoo domain", "slash-search",
-        "california", "city starts with san",
-      };
+      //every entry in a single pass.
+      if (data->diagram) {
+        Requirements::Mask present = 0;
+        thread->vm.i_.Prefetch(data->requirements, present);
+        thread->vm.runDiagram(data->entry, thread->results);
+      } else {
+        thread->vm.runAll(data->offsets, thread->results, data->requirements);
+      }
+
+      if ( ! profilePath.empty() && ++thread->transactions % kDump == 0) {
+        dump(*thread, *data);
+      }
+#endif
 
-      for (int i = 0; i < ARRAY_SIZE(names); ++i) {
-        if (vm.run(data->offsets[i])) {
+      for (uint32_t i = 0; i < names.size(); ++i) {
+#ifdef ENABLE_AOT
+        if (rules.run(i)) {
+#else
+        if (thread->results[i]) {
+#endif
           /*
            * replace here with your own logic.
            */
-          TSDebug(PLUGIN_TAG, "vm result says it is: %s", names[i]);
+          TSDebug(PLUGIN_TAG, "vm result says it is: %s",
+              names[i].c_str());
         }
       }
+
+#ifndef ENABLE_AOT
+      //the VM outlives the request, let go of its handles now.
+      thread->vm.i_.clear();
+#endif
     }
 
     TSHandleMLocRelease(buffer, TS_NULL_MLOC, header);
@@ -84,64 +220,65 @@ void TSPluginInit(int argc, const char * * argv) {
   TSCont continuation = TSContCreate(handler, NULL);
   ASSERT(continuation != NULL);
 
-  {
-    using namespace http::filters;
-    Forest f;
+  http::filters::BuildNames(names);
 
-    {
-      Tree t;
-      t.addAnd();
-        CHILD_OP(t, "isMethod", "GET");
-        OP(t, "isScheme", "http");
-        t.parent();
-      f.push_back(t);
-    }
+#ifndef ENABLE_AOT
+  pthread_key_create(&key, destroy);
 
-    {
-      Tree t;
-      t.addOr();
-        t.addChildAnd();
-          CHILD_OP(t, "existsHeader", "User-Agent");
-          OP(t, "containsHeader", "User-Agent", "Firefox");
-          t.parent();
-        t.addAnd();
-          CHILD_OP(t, "existsHeader", "user-agent");
-          OP(t, "containsHeader", "user-agent", "Firefox");
-          t.parent();
-        t.parent();
-      f.push_back(t);
+  //--image maps rules compiled ahead by build-image instead.
+  const char * imagePath = NULL;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--image") == 0 && i + 1 < argc) {
+      imagePath = argv[++i];
+    } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+      profilePath = argv[++i];
+    } else {
+      TSError("[%s] ignoring unknown argument %s", PLUGIN_TAG, argv[i]);
     }
+  }
 
-    {
-      Tree t;
-      OP(t, "containsDomain", ".yahoo.com");
-      f.push_back(t);
-    }
+  if ( ! profilePath.empty()) {
+    writer = TSContCreate(writeProfile, TSMutexCreate());
+    ASSERT(writer != NULL);
 
-    {
-      Tree t;
-      OP(t, "equalPath", "search");
-      f.push_back(t);
+    std::ifstream i(profilePath.c_str());
+    if (i.is_open() && ! profile.read(i)) {
+      TSDebug(PLUGIN_TAG, "ignoring malformed profile %s",
+          profilePath.c_str());
+      profile = http::filters::Profile();
     }
+  }
 
-    {
-      Tree t;
-      OP(t, "containsQueryParameter", "state", "california");
-      f.push_back(t);
+  if (imagePath != NULL) {
+    http::filters::Image * const image = new http::filters::Image();
+    if (image->load(imagePath)) {
+      names = image->names;
+      TSContDataSet(continuation, new Data(image));
+      TSHttpHookAdd(TS_HTTP_SEND_REQUEST_HDR_HOOK, continuation);
+      return;
     }
+    TSDebug(PLUGIN_TAG, "ignoring malformed image %s", imagePath);
+    delete image;
+  }
 
-    {
-      Tree t;
-      OP(t, "startsWithQueryParameter", "city", "san");
-      f.push_back(t);
-    }
+  {
+    using namespace http::filters;
+    Forest f;
+    BuildRules(f);
 
     {
       http::filters::Offsets o;
       o.reserve(f.size());
 
-      Compiler c;
+      Compiler c(CompilerFlags::kJumps | CompilerFlags::kReorder
+          | CompilerFlags::kAutomata | CompilerFlags::kSets
+          | CompilerFlags::kOptimize);
+      if ( ! profile.map_.empty()) {
+        c.profile_ = &profile;
+      }
       c.compile(f, o);
+      uint32_t entry = 0;
+      const bool diagram = c.compileDiagram(f, entry);
 
       cleanAll(f);
 
@@ -155,12 +292,10 @@ void TSPluginInit(int argc, const char * * argv) {
         std::cout << ss.str() << std::endl;
       }
 
-      const Offsets::const_iterator end = o.end();
-      Offsets::const_iterator it = o.begin();
-
-      TSContDataSet(continuation, new Data(c, o));
+      TSContDataSet(continuation, new Data(c, o, diagram, entry));
     }
   }
+#endif
 
   TSHttpHookAdd(TS_HTTP_SEND_REQUEST_HDR_HOOK, continuation);
 }
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#include <cstring>
+#include <map>
+
+#include "automaton.h"
+
+namespace http {
+namespace filters {
+
+const uint32_t Automaton::kHeader;
+const uint32_t Automaton::kState;
+
+void Automaton::Build(const std::vector< std::string > & n,
+    std::vector< uint32_t > & r) {
+  typedef std::map< uint8_t, uint32_t > Edges;
+  typedef std::vector< Edges > Trie;
+
+  Trie trie(1);
+  std::vector< uint32_t > output(1, 0);
+
+  for (uint32_t i = 0; i < n.size(); ++i) {
+    ASSERT( ! n[i].empty());
+    uint32_t s = 0;
+    for (uint32_t j = 0; j < n[i].size(); ++j) {
+      const uint8_t c = n[i][j];
+      const Edges::const_iterator it = trie[s].find(c);
+      if (it != trie[s].end()) {
+        s = it->second;
+      } else {
+        const uint32_t t = trie.size();
+        trie[s][c] = t;
+        trie.push_back(Edges());
+        output.push_back(0);
+        s = t;
+      }
+    }
+    ASSERT(output[s] == 0); //duplicated needle.
+    output[s] = i + 1;
+  }
+
+  //fail and next links, breadth first so shallower states are done first.
+  const uint32_t states = trie.size();
+  std::vector< uint32_t > fail(states, 0), next(states, 0), queue;
+  queue.reserve(states);
+  queue.push_back(0);
+  uint32_t edges = 0;
+
+  for (uint32_t q = 0; q < queue.size(); ++q) {
+    const uint32_t s = queue[q];
+    edges += trie[s].size();
+    const Edges::const_iterator END = trie[s].end();
+    for (Edges::const_iterator it = trie[s].begin(); it != END; ++it) {
+      const uint32_t t = it->second;
+      uint32_t f = fail[s];
+      if (s != 0) {
+        while (true) {
+          const Edges::const_iterator k = trie[f].find(it->first);
+          if (k != trie[f].end()) {
+            f = k->second;
+            break;
+          }
+          if (f == 0) {
+            break;
+          }
+          f = fail[f];
+        }
+      }
+      fail[t] = f;
+      next[t] = output[f] > 0 ? f : next[f];
+      queue.push_back(t);
+    }
+  }
+
+  r.clear();
+  r.push_back(states);
+  r.push_back(n.size());
+  r.push_back(edges);
+
+  uint32_t first = 0;
+  for (uint32_t s = 0; s < states; ++s) {
+    r.push_back(first);
+    r.push_back(trie[s].size());
+    r.push_back(fail[s]);
+    r.push_back(output[s]);
+    r.push_back(next[s]);
+    first += trie[s].size();
+  }
+
+  for (uint32_t s = 0; s < states; ++s) {
+    const Edges::const_iterator END = trie[s].end();
+    for (Edges::const_iterator it = trie[s].begin(); it != END; ++it) {
+      r.push_back(it->first);
+      r.push_back(it->second);
+    }
+  }
+
+  const uint32_t table = r.size();
+  r.resize(table + n.size());
+  for (uint32_t i = 0; i < n.size(); ++i) {
+    r[table + i] = r.size() * sizeof(uint32_t);
+    const uint32_t words = n[i].size() / sizeof(uint32_t) + 1;
+    const uint32_t begin = r.size();
+    r.resize(begin + words, 0);
+    memcpy(&r[begin], n[i].data(), n[i].size());
+  }
+}
+
+} //end of filters namespace
+} //end of http namespace
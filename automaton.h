@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#ifndef AUTOMATON_H
+#define AUTOMATON_H
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "my-assert.h"
+
+namespace http {
+namespace filters {
+
+/*
+ * Aho-Corasick automaton over a set of needles, flattened into 32 bit
+ * words so it lives in Memory and is used in place:
+ *
+ *   states, needles, edges
+ *   states times: first edge, edge count, fail, output, next
+ *   edges times: byte, target
+ *   needles times: byte offset of the needle from the beginning
+ *   the needles, NUL terminated, padded to a word.
+ *
+ * output is one plus the needle a state completes, next is the closest
+ * state down its fail chain completing one. Edges are sorted by byte.
+ */
+struct Automaton {
+  static const uint32_t kHeader = 3;
+  static const uint32_t kState = 5;
+
+  const uint32_t * const t_;
+
+  explicit Automaton(const char * const p) :
+    t_(reinterpret_cast< const uint32_t * >(p)) {
+    ASSERT(p != NULL);
+    ASSERT(reinterpret_cast< uintptr_t >(p) % sizeof(uint32_t) == 0);
+  }
+
+  inline uint32_t states(void) const { return t_[0]; }
+  inline uint32_t needles(void) const { return t_[1]; }
+  inline uint32_t edges(void) const { return t_[2]; }
+
+  inline const uint32_t * state(const uint32_t s) const {
+    ASSERT(s < states());
+    return t_ + kHeader + s * kState;
+  }
+
+  inline const char * needle(const uint32_t i) const {
+    ASSERT(i < needles());
+    return reinterpret_cast< const char * >(t_)
+      + t_[kHeader + states() * kState + edges() * 2 + i];
+  }
+
+  //the state reached from s on c, following fail links.
+  inline uint32_t step(uint32_t s, const uint8_t c) const {
+    const uint32_t * const e = t_ + kHeader + states() * kState;
+    while (true) {
+      const uint32_t * const k = state(s);
+      uint32_t begin = k[0], end = k[0] + k[1];
+      while (begin < end) {
+        const uint32_t middle = begin + (end - begin) / 2;
+        if (e[middle * 2] < c) {
+          begin = middle + 1;
+        } else {
+          end = middle;
+        }
+      }
+      if (begin < k[0] + k[1] && e[begin * 2] == c) {
+        return e[begin * 2 + 1];
+      }
+      if (s == 0) {
+        return 0;
+      }
+      s = k[2];
+    }
+  }
+
+  //calls f with the index of every needle found in p, once per match.
+  template < class F >
+  void scan(const char * const p, const uint32_t l, F & f) const {
+    uint32_t s = 0;
+    for (uint32_t i = 0; i < l; ++i) {
+      s = step(s, static_cast< uint8_t >(p[i]));
+      uint32_t o = state(s)[3] > 0 ? s : state(s)[4];
+      while (o != 0) {
+        f(state(o)[3] - 1);
+        o = state(o)[4];
+      }
+    }
+  }
+
+  //needles have to be distinct and not empty.
+  static void Build(const std::vector< std::string > &,
+      std::vector< uint32_t > &);
+};
+
+} //end of filters namespace
+} //end of http namespace
+
+#endif //AUTOMATON_H
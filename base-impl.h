@@ -9,9 +9,18 @@
 
 #include <stdint.h>
 
+#include "automaton.h"
+#include "hash-set.h"
+#include "requirements.h"
+#include "string-view.h"
+
 namespace http {
 namespace filters {
 
+/*
+ * Names, and the values Equal compares to, come with the length Program
+ * decoded for them, so implementations never measure them again.
+ */
 struct BaseImplementation {
 
   bool PrintError(const char * const, const char * const) const { return true; }
@@ -30,34 +39,72 @@ struct BaseImplementation {
   bool NotEqualPath(const char * const, const uint32_t) { return true; }
   bool StartsWithPath(const char * const, const uint32_t, const uint32_t) { return true; }
 
-  bool ContainsQueryParameter(const char * const, const char * const) {return true; }
-  bool EqualQueryParameter(const char * const, const char * const) { return true; }
-  bool ExistsQueryParameter(const char * const) { return true; }
-  bool GreaterThanQueryParameter(const char * const, const int64_t) { return true; }
-  bool GreaterThanAfterQueryParameter(const char * const, const char * const, const int64_t) { return true; }
-  bool LessThanQueryParameter(const char * const, const int64_t) { return true; }
-  bool LessThanAfterQueryParameter(const char * const, const char * const, const int64_t) { return true; }
-  bool NotEqualQueryParameter(const char * const, const char * const) { return true; }
-  bool StartsWithQueryParameter(const char * const, const char * const, const uint32_t) { return true; }
-
-  bool ContainsHeader(const char * const, const char * const) { return true; }
-  bool EqualHeader(const char * const, const char * const) { return true; }
-  bool ExistsHeader(const char * const) { return true; }
-  bool GreaterThanHeader(const char * const, const int64_t) { return true; }
-  bool GreaterThanAfterHeader(const char * const, const char * const, const int64_t) { return true; }
-  bool LessThanHeader(const char * const, const int64_t) { return true; }
-  bool LessThanAfterHeader(const char * const, const char * const, const int64_t) { return true; }
-  bool NotEqualHeader(const char * const, const char * const) { return true; }
-  bool StartsWithHeader(const char * const, const char * const, const uint32_t) { return true; }
-
-  bool ContainsCookie(const char * const, const char * const) { return true; }
-  bool EqualCookie(const char * const, const char * const) { return true; }
-  bool ExistsCookie(const char * const) { return true; }
-  bool GreaterThanCookie(const char * const, const int64_t) { return true; }
-  bool GreaterThanAfterCookie(const char * const, const char * const, const int64_t) { return true; }
-  bool LessThanCookie(const char * const, const int64_t) { return true; }
-  bool LessThanAfterCookie(const char * const, const char * const, const int64_t) { return true; }
-  bool NotEqualCookie(const char * const, const char * const) { return true; }
+  bool ContainsQueryParameter(const util::StringView &, const char * const) {return true; }
+  bool EqualQueryParameter(const util::StringView &, const util::StringView &) { return true; }
+  bool ExistsQueryParameter(const util::StringView &) { return true; }
+  bool GreaterThanQueryParameter(const util::StringView &, const int64_t) { return true; }
+  bool GreaterThanAfterQueryParameter(const util::StringView &, const char * const, const int64_t) { return true; }
+  bool LessThanQueryParameter(const util::StringView &, const int64_t) { return true; }
+  bool LessThanAfterQueryParameter(const util::StringView &, const char * const, const int64_t) { return true; }
+  bool NotEqualQueryParameter(const util::StringView &, const util::StringView &) { return true; }
+  bool StartsWithQueryParameter(const util::StringView &, const char * const, const uint32_t) { return true; }
+
+  bool ContainsHeader(const util::StringView &, const char * const) { return true; }
+  bool EqualHeader(const util::StringView &, const util::StringView &) { return true; }
+  bool ExistsHeader(const util::StringView &) { return true; }
+  bool GreaterThanHeader(const util::StringView &, const int64_t) { return true; }
+  bool GreaterThanAfterHeader(const util::StringView &, const char * const, const int64_t) { return true; }
+  bool LessThanHeader(const util::StringView &, const int64_t) { return true; }
+  bool LessThanAfterHeader(const util::StringView &, const char * const, const int64_t) { return true; }
+  bool NotEqualHeader(const util::StringView &, const util::StringView &) { return true; }
+  bool StartsWithHeader(const util::StringView &, const char * const, const uint32_t) { return true; }
+
+  //the value is folded to lower case, see fold.h.
+  bool ContainsHeaderI(const util::StringView &, const char * const) { return true; }
+  bool EqualHeaderI(const util::StringView &, const util::StringView &) { return true; }
+  bool NotEqualHeaderI(const util::StringView &, const util::StringView &) { return true; }
+
+  bool ContainsCookie(const util::StringView &, const char * const) { return true; }
+  bool EqualCookie(const util::StringView &, const util::StringView &) { return true; }
+  bool ExistsCookie(const util::StringView &) { return true; }
+  bool GreaterThanCookie(const util::StringView &, const int64_t) { return true; }
+  bool GreaterThanAfterCookie(const util::StringView &, const char * const, const int64_t) { return true; }
+  bool LessThanCookie(const util::StringView &, const int64_t) { return true; }
+  bool LessThanAfterCookie(const util::StringView &, const char * const, const int64_t) { return true; }
+  bool NotEqualCookie(const util::StringView &, const util::StringView &) { return true; }
+
+  /*
+   * Single pass over a value reporting every needle of the automaton found
+   * in it through f. Returning false asks for one needle at a time.
+   */
+  template < class F >
+  bool ContainsManyDomain(const Automaton &, F &) { return false; }
+  template < class F >
+  bool ContainsManyPath(const Automaton &, F &) { return false; }
+  template < class F >
+  bool ContainsManyQueryParameter(const util::StringView &, const Automaton &,
+      F &) { return false; }
+  template < class F >
+  bool ContainsManyHeader(const util::StringView &, const Automaton &, F &) {
+    return false;
+  }
+  template < class F >
+  bool ContainsManyCookie(const util::StringView &, const Automaton &, F &) {
+    return false;
+  }
+
+  /*
+   * Looks the domain or the path up in the set, into the 2nd argument.
+   * Returning false asks for one string at a time.
+   */
+  bool EqualDomainSet(const HashSet &, bool &) { return false; }
+  bool EqualPathSet(const HashSet &, bool &) { return false; }
+
+  /*
+   * Fetches at once what the entries read, and sets the bit of every name
+   * present. Returning false leaves entries to fetch what they read.
+   */
+  bool Prefetch(const Requirements &, Requirements::Mask &) { return false; }
 };
 
 } //end of filters namespace
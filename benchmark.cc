@@ -0,0 +1,529 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include <cstring>
+
+#include <stdint.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "my-assert.h"
+
+#include "base-impl.h"
+#include "compiler.h"
+#include "generator.h"
+#include "image.h"
+#include "representation.h"
+#include "vm-impl.h"
+
+/*
+ * benchmark-aot.h is this same forest translated by "./benchmark generate",
+ * see the bench-aot target.
+ */
+#ifdef ENABLE_AOT
+#include "benchmark-aot.h"
+#endif
+
+using namespace http::filters;
+
+static const uint32_t kGenerated = 1000;
+
+/*
+ * Answers every predicate from the contents of its first operand, so the
+ * forests below take a mix of short-circuit paths without touching a real
+ * request, and the VM and the generated code see the same answers.
+ */
+struct BenchmarkImplementation : BaseImplementation {
+  static inline bool Parity(const char * a) {
+    uint32_t h = 0;
+    for (; *a != '\0'; ++a) {
+      h = h * 31 + *a;
+    }
+    return (h >> 3) & 0x1;
+  }
+
+  bool IsMethod(const char * const a, const uint32_t) { return Parity(a); }
+  bool ContainsDomain(const char * const a, const uint32_t) { return Parity(a); }
+  bool EqualPath(const char * const a, const uint32_t) { return Parity(a); }
+  bool ExistsHeader(const char * const a) { return Parity(a); }
+  bool ContainsHeader(const char * const a, const char * const b) {
+    return Parity(a) && Parity(b);
+  }
+  bool ExistsCookie(const char * const a) { return ! Parity(a); }
+  //a comparison implies its name exists, fused instructions rely on it.
+  bool EqualCookie(const char * const a, const char * const b) {
+    return ! Parity(a) && Parity(b);
+  }
+  bool ContainsQueryParameter(const char * const, const char * const b) {
+    return Parity(b);
+  }
+};
+
+struct Random {
+  uint32_t s_;
+  Random(const uint32_t s) : s_(s) { }
+  inline uint32_t operator () (const uint32_t m) {
+    s_ = s_ * 1103515245 + 12345;
+    return (s_ >> 16) % m;
+  }
+};
+
+static std::string Name(const char * const p, const uint32_t i) {
+  std::stringstream ss;
+  ss << p << i;
+  return ss.str();
+}
+
+static void AddOp(Tree & t, Random & r, const bool child) {
+  const char * n = NULL;
+  Op::Parameters p;
+  switch (r(7)) {
+  case 0:
+    n = "isMethod";
+    p.push_back(r(2) ? "GET" : "POST");
+    break;
+  case 1:
+    n = "containsDomain";
+    p.push_back(Name(".domain", r(32)));
+    break;
+  case 2:
+    n = "equalPath";
+    p.push_back(Name("/path/", r(256)));
+    break;
+  case 3:
+    n = "existsHeader";
+    p.push_back(Name("X-Header-", r(16)));
+    break;
+  case 4:
+    n = "containsHeader";
+    p.push_back(Name("X-Header-", r(16)));
+    p.push_back(Name("value", r(64)));
+    break;
+  case 5:
+    n = "existsCookie";
+    p.push_back(Name("cookie", r(16)));
+    break;
+  default:
+    n = "equalCookie";
+    p.push_back(Name("cookie", r(16)));
+    p.push_back(Name("value", r(64)));
+    break;
+  }
+  if (child) {
+    t.addChildOp(n, p);
+  } else {
+    t.addOp(n, p);
+  }
+}
+
+static void AddList(Tree & t, Random & r, const uint32_t d, bool child) {
+  const uint32_t s = 1 + r(4);
+  for (uint32_t i = 0; i < s; ++i, child = false) {
+    if (r(5) == 0) {
+      if (child) { t.addChildNot(); } else { t.addNot(); }
+      child = false;
+    }
+    if (d > 0 && r(3) == 0) {
+      if (r(2)) {
+        if (child) { t.addChildAnd(); } else { t.addAnd(); }
+      } else {
+        if (child) { t.addChildOr(); } else { t.addOr(); }
+      }
+      AddList(t, r, d - 1, true);
+      t.parent();
+    } else {
+      AddOp(t, r, child);
+    }
+  }
+}
+
+static void Build(Forest & f, const uint32_t s) {
+  Random r(s);
+  for (uint32_t i = 0; i < s; ++i) {
+    Tree t;
+    if (r(2)) {
+      t.addAnd();
+    } else {
+      t.addOr();
+    }
+    AddList(t, r, 2, true);
+    t.parent();
+    f.push_back(t);
+  }
+}
+
+static inline double Now(void) {
+  struct timeval t;
+  gettimeofday(&t, NULL);
+  return t.tv_sec * 1e9 + t.tv_usec * 1e3;
+}
+
+static void Run(const uint32_t s,
+    const uint32_t flags = CompilerFlags::kNone) {
+  Forest f;
+  Build(f, s);
+
+  Offsets o;
+  o.reserve(f.size());
+  Compiler c(flags);
+  c.compile(f, o);
+  cleanAll(f);
+
+  const Program program(c.assembler_.code(), c.assembler_.memory());
+  const uint32_t instructions = c.assembler_.codeSize();
+  const uint32_t iterations = 1 + 2000000 / instructions;
+
+  uint32_t matches = 0;
+  const double begin = Now();
+  //one VM reset per transaction, as the plugin does.
+  VM< BenchmarkImplementation > vm(BenchmarkImplementation(), program);
+  for (uint32_t i = 0; i < iterations; ++i) {
+    vm.reset(BenchmarkImplementation());
+    const Offsets::const_iterator end = o.end();
+    for (Offsets::const_iterator it = o.begin(); it != end; ++it) {
+      matches += vm.run(*it);
+    }
+  }
+  const double elapsed = Now() - begin;
+
+  std::cout << std::setw(8) << s << " rules "
+    << (flags & CompilerFlags::kJumps ? "jumps " : "")
+    << (flags & CompilerFlags::kReorder ? "reorder " : "")
+    << (flags & CompilerFlags::kAutomata ? "automata " : "")
+    << (flags & CompilerFlags::kSets ? "sets " : "")
+    << (flags & CompilerFlags::kOptimize ? "optimize " : "")
+    << std::setw(10) << instructions << " instructions "
+    << std::setw(12) << std::fixed << std::setprecision(1)
+    << elapsed / iterations << " ns/transaction "
+    << std::setw(8) << std::setprecision(2)
+    << elapsed / (static_cast< double >(iterations) * instructions)
+    << " ns/instruction "
+    << "(" << matches / iterations << " matches)" "\n";
+
+  std::cout << std::setw(8) << s << " rules compiled: ";
+  c.report(std::cout);
+  std::cout << "\n";
+
+#ifdef ENABLE_AOT
+  if (s != kGenerated || flags != CompilerFlags::kNone) {
+    return;
+  }
+
+  {
+    //both backends have to agree on every entry.
+    VM< BenchmarkImplementation > vm(BenchmarkImplementation(), program);
+    BenchmarkImplementation i;
+    Generated< BenchmarkImplementation > g(i);
+    ASSERT(o.size() == g.kEntries);
+    for (uint32_t j = 0; j < o.size(); ++j) {
+      if (vm.run(o[j]) != g.run(j)) {
+        std::cerr << "entry " << j << " differs" "\n";
+        exit(1);
+      }
+    }
+  }
+
+  uint32_t generated = 0;
+  const double start = Now();
+  for (uint32_t i = 0; i < iterations; ++i) {
+    BenchmarkImplementation implementation;
+    Generated< BenchmarkImplementation > g(implementation);
+    for (uint32_t j = 0; j < g.kEntries; ++j) {
+      generated += g.run(j);
+    }
+  }
+  const double duration = Now() - start;
+
+  std::cout << std::setw(8) << s << " rules "
+    << std::setw(10) << "generated" " code  "
+    << std::setw(12) << std::fixed << std::setprecision(1)
+    << duration / iterations << " ns/transaction "
+    << "(" << generated / iterations << " matches)" "\n";
+#endif
+}
+
+/*
+ * The forest as a single decision diagram against running every tree, see
+ * Compiler::compileDiagram.
+ */
+static void Diagrams(const uint32_t s) {
+  Forest f;
+  Build(f, s);
+
+  Offsets o;
+  Compiler c;
+  c.compile(f, o);
+  uint32_t e = 0;
+  const uint32_t begin = c.assembler_.codeSize();
+  const bool compiled = c.compileDiagram(f, e);
+  cleanAll(f);
+
+  if ( ! compiled) {
+    std::cout << std::setw(8) << s << " rules diagram too large" "\n";
+    return;
+  }
+
+  const Program program(c.assembler_.code(), c.assembler_.memory());
+  const uint32_t iterations = 1 + 2000000 / c.assembler_.codeSize();
+  Bitmap a(o.size()), b(o.size());
+
+  uint32_t matches = 0;
+  const double start = Now();
+  VM< BenchmarkImplementation > vm(BenchmarkImplementation(), program);
+  for (uint32_t i = 0; i < iterations; ++i) {
+    vm.reset(BenchmarkImplementation());
+    vm.runDiagram(e, b);
+    matches += vm.matches_[0];
+  }
+  const double elapsed = Now() - start;
+
+  //both have to agree on every entry.
+  VM< BenchmarkImplementation > trees(BenchmarkImplementation(), program);
+  trees.runAll(o, a);
+  for (uint32_t j = 0; j < o.size(); ++j) {
+    if (static_cast< bool >(a[j]) != static_cast< bool >(b[j])) {
+      std::cerr << "entry " << j << " differs" "\n";
+      exit(1);
+    }
+  }
+
+  std::cout << std::setw(8) << s << " rules diagram "
+    << std::setw(10) << c.assembler_.codeSize() - begin << " instructions "
+    << std::setw(12) << std::fixed << std::setprecision(1)
+    << elapsed / iterations << " ns/transaction "
+    << "(" << matches / iterations << " matches)" "\n";
+}
+
+//ns per transaction running every entry, as Run does, and the matches.
+static double Transactions(VM< BenchmarkImplementation > & vm,
+    const Offsets & o, const uint32_t iterations, uint32_t & matches) {
+  matches = 0;
+  const double begin = Now();
+  for (uint32_t i = 0; i < iterations; ++i) {
+    vm.reset(BenchmarkImplementation());
+    const Offsets::const_iterator end = o.end();
+    for (Offsets::const_iterator it = o.begin(); it != end; ++it) {
+      matches += vm.run(*it);
+    }
+  }
+  return (Now() - begin) / iterations;
+}
+
+/*
+ * Compares the two code encodings: the size of the image and the time
+ * running what each decodes into.
+ */
+static void Encodings(const uint32_t s) {
+  Forest f;
+  Build(f, s);
+
+  Offsets o;
+  Compiler c;
+  c.compile(f, o);
+  cleanAll(f);
+
+  const Code code = c.assembler_.code();
+  const CompactCode compact = c.assembler_.compact();
+  const uint32_t iterations = 1 + 2000000 / compact.size();
+
+  VM< BenchmarkImplementation > a(BenchmarkImplementation(), code,
+      c.assembler_.memory());
+  VM< BenchmarkImplementation > b(BenchmarkImplementation(), compact,
+      c.assembler_.memory());
+
+  //both encodings have to decode into the same results.
+  for (uint32_t j = 0; j < o.size(); ++j) {
+    if (a.run(o[j]) != b.run(o[j])) {
+      std::cerr << "entry " << j << " differs" "\n";
+      exit(1);
+    }
+  }
+
+  uint32_t matches = 0;
+  const double wide = Transactions(a, o, iterations, matches),
+        narrow = Transactions(b, o, iterations, matches);
+
+  const uint32_t bytes = code.size * sizeof(uint32_t);
+  std::cout << std::setw(8) << s << " rules "
+    << std::setw(10) << bytes << " bytes code    "
+    << std::setw(10) << compact.bytes() << " bytes compact "
+    << std::setw(12) << std::fixed << std::setprecision(1)
+    << wide << " / " << narrow << " ns/transaction "
+    << "(" << matches / iterations << " matches)" "\n";
+}
+
+static uint32_t CountOperands(const Node * n) {
+  uint32_t r = 0;
+  for (; n != NULL; n = n->next) {
+    const BinaryNode * const b = dynamic_cast< const BinaryNode * >(n);
+    const Op * const o = dynamic_cast< const Op * >(n);
+    r += b != NULL ? CountOperands(b->child)
+      : o != NULL ? o->parameters.size() : 0;
+  }
+  return r;
+}
+
+/*
+ * What interning operands costs the Assembler, against keeping them in a
+ * std::map: s pushes, a quarter of them distinct. Then compiling a forest
+ * of at least s operands.
+ */
+static void Interning(const uint32_t s) {
+  std::vector< std::string > strings(s);
+  for (uint32_t i = 0; i < s; ++i) {
+    std::ostringstream o;
+    o << "operand-" << (i * 2654435761u) % (s / 4);
+    strings[i] = o.str();
+  }
+
+  double begin = Now();
+  Assembler a;
+  for (uint32_t i = 0; i < s; ++i) {
+    a.pushMemory(strings[i].c_str());
+  }
+  const double interned = Now() - begin;
+
+  begin = Now();
+  std::map< std::string, uint32_t > m;
+  for (uint32_t i = 0; i < s; ++i) {
+    m.insert(std::make_pair(strings[i], i));
+  }
+  const double mapped = Now() - begin;
+
+  //sized from a sample, so the forest has about s operands.
+  Forest f;
+  Build(f, s / 16);
+  uint32_t operands = 0;
+  for (uint32_t i = 0; i < f.size(); ++i) {
+    operands += CountOperands(f[i].root());
+  }
+  const uint32_t sample = f.size();
+  cleanAll(f);
+  f.clear();
+  Build(f, static_cast< uint64_t >(s) * sample / operands);
+  operands = 0;
+  for (uint32_t i = 0; i < f.size(); ++i) {
+    operands += CountOperands(f[i].root());
+  }
+  const uint32_t rules = f.size();
+  begin = Now();
+  Offsets o;
+  Compiler c;
+  c.compile(f, o);
+  const double compiled = Now() - begin;
+  cleanAll(f);
+
+  std::cout << std::setw(8) << s << " operands "
+    << std::setw(10) << a.memory_.size() << " bytes memory "
+    << std::setw(10) << std::fixed << std::setprecision(1)
+    << interned / 1e6 << " ms interned " << mapped / 1e6 << " ms in a map "
+    << compiled / 1e6 << " ms to compile " << rules << " rules ("
+    << operands << " operands)" "\n";
+}
+
+/*
+ * Starting from an image against compiling the rules: what mapping and
+ * checking it takes, then decoding its Program.
+ */
+static void Images(const uint32_t s) {
+  Forest f;
+  Build(f, s);
+
+  double begin = Now();
+  Offsets o;
+  Compiler c(CompilerFlags::kJumps | CompilerFlags::kReorder
+      | CompilerFlags::kAutomata | CompilerFlags::kSets);
+  c.compile(f, o);
+  const double compile = Now() - begin;
+  cleanAll(f);
+
+  Image i;
+  i.code = c.assembler_.code();
+  i.memory = c.assembler_.memory();
+  i.offsets = o;
+  i.requirements = c.requirements_;
+  for (uint32_t j = 0; j < o.size(); ++j) {
+    std::ostringstream n;
+    n << "rule " << j;
+    i.names.push_back(n.str());
+  }
+
+  char path [] = "/tmp/benchmark-image-XXXXXX";
+  const int d = mkstemp(path);
+  if (d < 0) {
+    std::cerr << "could not create an image" "\n";
+    exit(1);
+  }
+  close(d);
+  {
+    std::ofstream out(path, std::ios::binary);
+    i.write(out);
+  }
+
+  begin = Now();
+  Image l;
+  const bool loaded = l.load(path);
+  const double load = Now() - begin;
+  unlink(path);
+  if ( ! loaded) {
+    std::cerr << "could not load the image" "\n";
+    exit(1);
+  }
+  begin = Now();
+  const Program program(l.code, l.memory);
+  const double decode = Now() - begin;
+
+  std::cout << std::setw(8) << s << " rules "
+    << std::setw(10) << l.size_ << " bytes image "
+    << std::setw(10) << std::fixed << std::setprecision(1)
+    << compile / 1e6 << " ms to compile "
+    << load / 1e6 << " ms to load "
+    << decode / 1e6 << " ms to decode" "\n";
+}
+
+int main(const int argc, const char * const * const argv) {
+  if (argc > 1 && strcmp(argv[1], "generate") == 0) {
+    Forest f;
+    Build(f, kGenerated);
+    Generator g("Generated");
+    g.generate(f, std::cout);
+    cleanAll(f);
+    return 0;
+  }
+
+#ifdef USE_COMPUTED_GOTO
+  std::cout << "dispatch: computed goto" "\n";
+#else
+  std::cout << "dispatch: switch" "\n";
+#endif
+  Run(10);
+  Run(10, CompilerFlags::kJumps);
+  Run(kGenerated);
+  Run(kGenerated, CompilerFlags::kJumps);
+  Run(100000);
+  Run(100000, CompilerFlags::kJumps);
+  Run(100000, CompilerFlags::kJumps | CompilerFlags::kReorder);
+  Run(100000, CompilerFlags::kJumps | CompilerFlags::kReorder
+      | CompilerFlags::kAutomata | CompilerFlags::kSets);
+  Run(100000, CompilerFlags::kJumps | CompilerFlags::kReorder
+      | CompilerFlags::kAutomata | CompilerFlags::kSets
+      | CompilerFlags::kOptimize);
+  Diagrams(10);
+  Diagrams(100);
+  Diagrams(kGenerated);
+  Encodings(kGenerated);
+  Encodings(100000);
+  Interning(1000000);
+  Images(200000);
+  return 0;
+}
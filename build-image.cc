@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#include <fstream>
+#include <iostream>
+
+#include "compiler.h"
+#include "image.h"
+#include "profile.h"
+#include "representation.h"
+#include "rules.h"
+
+/*
+ * Compiles the plugin rules the way the plugin does and writes the image
+ * it maps on start, see Image. Optionally ordered by a profile.
+ */
+int main(const int argc, const char * const * const argv) {
+  using namespace http::filters;
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " image [profile]" "\n";
+    return 1;
+  }
+
+  Profile profile;
+  if (argc > 2) {
+    std::ifstream i(argv[2]);
+    if ( ! i.is_open() || ! profile.read(i)) {
+      std::cerr << "malformed profile " << argv[2] << "\n";
+      return 1;
+    }
+  }
+
+  Forest f;
+  BuildRules(f);
+
+  Offsets o;
+  o.reserve(f.size());
+  Compiler c(CompilerFlags::kJumps | CompilerFlags::kReorder
+      | CompilerFlags::kAutomata | CompilerFlags::kSets
+      | CompilerFlags::kOptimize);
+  if ( ! profile.map_.empty()) {
+    c.profile_ = &profile;
+  }
+  c.compile(f, o);
+
+  Image image;
+  image.diagram = c.compileDiagram(f, image.entry);
+  cleanAll(f);
+
+  image.code = c.assembler_.code();
+  image.memory = c.assembler_.memory();
+  image.offsets = o;
+  BuildNames(image.names);
+  image.requirements = c.requirements_;
+
+  std::ofstream out(argv[1], std::ios::binary);
+  if ( ! image.write(out)) {
+    std::cerr << "could not write " << argv[1] << "\n";
+    return 1;
+  }
+  return 0;
+}
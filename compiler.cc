@@ -5,34 +5,334 @@
  */
 
 #include "my-assert.h"
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <set>
+#include <sstream>
 
+#include "automaton.h"
 #include "compiler.h"
+#include "hash-set.h"
+#include "optimizer.h"
 
 namespace http {
 namespace filters {
 
-Compiler::Compiler(void) {
+Compiler::Compiler(const uint32_t f) : flags_(f), profile_(NULL),
+  tombstone_(0) {
   assembler_.pushSkip();
 }
 void Compiler::compile(const Forest & f, Offsets & r) {
   typedef Forest::const_iterator Iterator;
   const Iterator END = f.end();
+
+  if (flags_ & CompilerFlags::kAutomata) {
+    for (Iterator it = f.begin(); it != END; ++it) {
+      collect(it->root());
+    }
+    automata();
+  }
+
   for (Iterator it = f.begin(); it != END; ++it) {
     r.push_back(compile(*it));
+    requirements_.add(*it);
+  }
+
+  if (flags_ & CompilerFlags::kOptimize) {
+    optimize(r);
+  }
+}
+
+/*
+ * Identical trees share their entry. It is the very same code that runs,
+ * so this holds even for trees with prints.
+ */
+uint32_t Compiler::compile(const Tree & t) {
+  if (t.root() == NULL) {
+    return 0;
+  }
+
+  //nodes of a previous tree may have been freed and their address reused.
+  ids_.clear();
+  std::stringstream key;
+  for (const Node * n = t.root(); n != NULL; n = n->next) {
+    key << cons(n) << ",";
+  }
+
+  ++report_.entries;
+  const Entries::const_iterator it = entries_.find(key.str());
+  if (it != entries_.end()) {
+    ++report_.sharedEntries;
+    report_.saved += it->second.second;
+    return it->second.first;
+  }
+
+  const uint32_t begin = assembler_.codeSize();
+  uint32_t result = 0;
+  if (flags_ & CompilerFlags::kJumps) {
+    result = begin;
+    compileJumps(t.root());
+    PushReturn(assembler_);
+  } else {
+    result = compileSimple(t.root());
+  }
+  assembler_.pushHalt();
+
+  entries_.insert(std::make_pair(key.str(),
+        Entry(result, assembler_.codeSize() - begin)));
+  return result;
+}
+
+/*
+ * The whole forest as a single decision diagram over its distinct
+ * predicates, cheaper ones tested first, see Diagram. Running it tests
+ * each predicate on the path at most once and ends in a kMatches with
+ * every true entry, see VM::runDiagram. Gives up, emitting nothing, when
+ * a tree prints or the diagram grows past kMaximumVertices.
+ */
+bool Compiler::compileDiagram(const Forest & f, uint32_t & r) {
+  typedef Forest::const_iterator Iterator;
+  const Iterator END = f.end();
+
+  //every tree is alive until the end, their addresses are unique.
+  ids_.clear();
+
+  Nodes predicates;
+  {
+    Variables seen;
+    Nodes stack;
+    for (Iterator it = f.begin(); it != END; ++it) {
+      for (const Node * n = it->root(); n != NULL; n = n->next) {
+        if ( ! pure_[cons(n)]) {
+          return false;
+        }
+        stack.push_back(n);
+      }
+      while ( ! stack.empty()) {
+        const Node * const n = stack.back();
+        stack.pop_back();
+        if (n->hasChild()) {
+          const BinaryNode * const b = dynamic_cast< const BinaryNode * >(n);
+          ASSERT(b != NULL);
+          for (const Node * i = b->child; i != NULL; i = i->next) {
+            stack.push_back(i);
+          }
+        } else if (n->type() == NodeTypes::kOp
+            && seen.insert(std::make_pair(cons(n), 0)).second) {
+          predicates.push_back(n);
+        }
+      }
+    }
+  }
+
+  std::vector< std::pair< uint32_t, uint32_t > > costs;
+  costs.reserve(predicates.size());
+  for (uint32_t i = 0; i < predicates.size(); ++i) {
+    costs.push_back(std::make_pair(cost(predicates[i]), i));
+  }
+  std::sort(costs.begin(), costs.end());
+
+  Nodes ordered;
+  Variables variables;
+  ordered.reserve(predicates.size());
+  for (uint32_t i = 0; i < costs.size(); ++i) {
+    const Node * const n = predicates[costs[i].second];
+    variables[cons(n)] = i;
+    ordered.push_back(n);
+  }
+
+  Diagram d(kMaximumVertices);
+  uint32_t root = d.terminal(Diagram::Set());
+  uint32_t e = 0;
+  for (Iterator it = f.begin(); it != END; ++it, ++e) {
+    const uint32_t t = function(d, it->root(), ExecutionMode::kNone,
+        variables);
+    root = d.apply(Diagram::kUnion, root, d.label(t, e));
+    if (d.overflow()) {
+      return false;
+    }
+  }
+
+  Addresses addresses;
+  r = emit(d, root, ordered, addresses);
+  return true;
+}
+
+/*
+ * What a list evaluates to, as the VM does: And / Or of its items, or the
+ * last item at the top level. A Not applies to the next item.
+ */
+uint32_t Compiler::function(Diagram & d, const Node * n,
+    const ExecutionMode::MODES m, const Variables & v) {
+  uint32_t r = d.boolean(m != ExecutionMode::kOr);
+  bool negated = false;
+  for (; n != NULL; n = n->next) {
+    uint32_t i = 0;
+    switch (n->type()) {
+    case NodeTypes::kNot:
+      negated = true;
+      continue;
+
+    case NodeTypes::kAnd:
+    case NodeTypes::kOr:
+      {
+        const BinaryNode * const b = dynamic_cast< const BinaryNode * >(n);
+        ASSERT(b != NULL);
+        ASSERT(b->child != NULL);
+        i = function(d, b->child, n->type() == NodeTypes::kAnd
+            ? ExecutionMode::kAnd : ExecutionMode::kOr, v);
+      }
+      break;
+
+    case NodeTypes::kOp:
+      {
+        const Variables::const_iterator it = v.find(cons(n));
+        ASSERT(it != v.end());
+        i = d.variable(it->second);
+      }
+      break;
+
+    default: ASSERT(false); break; //unrecheable
+    }
+
+    if (negated) {
+      i = d.negate(i);
+      negated = false;
+    }
+
+    switch (m) {
+    case ExecutionMode::kAnd: r = d.apply(Diagram::kIntersection, r, i); break;
+    case ExecutionMode::kOr: r = d.apply(Diagram::kUnion, r, i); break;
+    default: r = i; break;
+    }
+  }
+  return r;
+}
+
+/*
+ * A vertex is its predicate, a kJumpIfFalse to its low child and its high
+ * child right after, or a kJump to it when it was emitted already.
+ */
+uint32_t Compiler::emit(const Diagram & d, const uint32_t v,
+    const Nodes & p, Addresses & a) {
+  const Addresses::const_iterator it = a.find(v);
+  if (it != a.end()) {
+    return it->second;
+  }
+
+  const uint32_t r = assembler_.codeSize();
+  a.insert(std::make_pair(v, r));
+
+  if (d.terminal(v)) {
+    assembler_.pushMatches(d.set(v));
+    assembler_.pushHalt();
+    return r;
+  }
+
+  const Diagram::Vertex x = d[v];
+  ASSERT(x.variable < p.size());
+  dispatch(p[x.variable]);
+  const uint32_t jump = assembler_.codeSize();
+  assembler_.pushJumpIfFalse(0);
+
+  const Addresses::const_iterator h = a.find(x.high);
+  if (h != a.end()) {
+    assembler_.pushJump(h->second);
+  } else {
+    emit(d, x.high, p, a);
+  }
+  assembler_.patch(jump, emit(d, x.low, p, a));
+  return r;
+}
+
+/*
+ * Addresses change, so code compiled afterwards shares nothing with the
+ * code before it. o has to hold every entry, the rest is dropped.
+ */
+void Compiler::optimize(Offsets & o) {
+  report_.optimized += Optimizer(assembler_).optimize(o);
+  entries_.clear();
+  blocks_.assign(blocks_.size(), Block());
+}
+
+/*
+ * A tree compiled after the forest. Its contains predicates are not
+ * collected into automata, they only reuse the needles already there.
+ */
+uint32_t Compiler::append(const Tree & t, Offsets & o) {
+  o.push_back(compile(t));
+  requirements_.add(t);
+  return o.size() - 1;
+}
+
+//its code stays until compact, other entries may share it.
+void Compiler::remove(const uint32_t e, Offsets & o) {
+  ASSERT(e < o.size());
+  if (tombstone_ == 0) {
+    tombstone_ = assembler_.codeSize();
+    assembler_.pushFalse();
+    assembler_.pushHalt();
+  }
+  o[e] = tombstone_;
+  requirements_.remove(e);
+}
+
+/*
+ * Drops the code no entry reaches any more, then the memory no
+ * instruction refers to. Every cache pointing into either is cleared, so
+ * trees appended afterwards share nothing with what came before.
+ */
+void Compiler::compact(Offsets & o) {
+  Offsets e(o);
+  if (tombstone_ != 0) {
+    e.push_back(tombstone_);
+  }
+  report_.compacted += Optimizer(assembler_).collect(e);
+  if (tombstone_ != 0) {
+    tombstone_ = e.back();
+    e.pop_back();
+  }
+  o.swap(e);
+  assembler_.compactMemory();
+
+  entries_.clear();
+  blocks_.assign(blocks_.size(), Block());
+  targets_.clear();
+  tables_.clear();
+}
+
+void Compiler::report(std::ostream & o) const {
+  const uint32_t size = assembler_.codeSize();
+  o << report_.entries << " entries (" << report_.sharedEntries
+    << " shared), " << report_.blocks << " blocks ("
+    << report_.sharedBlocks << " shared), " << size << " instructions, "
+    << report_.saved << " saved ("
+    << (100.0 * report_.saved / (size + report_.saved)) << "%)";
+  if (report_.optimized > 0) {
+    o << ", " << report_.optimized << " optimized";
+  }
+  if (report_.compacted > 0) {
+    o << ", " << report_.compacted << " compacted";
   }
 }
 
-uint32_t Compiler::compileSimple(const Node * const n) {
+uint32_t Compiler::compileSimple(const Node * const n,
+    const ExecutionMode::MODES m) {
   typedef std::pair< const Node *, uint32_t > Pair;
   typedef std::vector< Pair > Offsets;
+  typedef std::vector< uint32_t > Ids;
   Offsets offsets;
+  Ids ids;
   ASSERT(n != NULL);
 
-  const Node * i = n,
-        * j = i->next;
+  Nodes nodes;
+  order(n, m, nodes);
+  merge(m, nodes);
+  const Nodes::const_iterator END = nodes.end();
 
-  while (i != NULL) {
+  for (Nodes::const_iterator l = nodes.begin(); l != END; ++l) {
+    const Node * const i = *l;
     if (i->hasChild()) {
       const int nodeType = i->type();
       const BinaryNode * k = dynamic_cast< const BinaryNode * >(i);
@@ -40,20 +340,38 @@ uint32_t Compiler::compileSimple(const Node * const n) {
       ASSERT(nodeType == NodeTypes::kAnd
           || nodeType == NodeTypes::kOr);
       ASSERT(k->child != NULL);
-      offsets.push_back(std::make_pair(i,
-            compileSimple(k->child)));
+      const uint32_t id = cons(i);
+      if ( ! pure_[id]) {
+        offsets.push_back(std::make_pair(i,
+              compileSimple(k->child, nodeType == NodeTypes::kAnd
+                ? ExecutionMode::kAnd : ExecutionMode::kOr)));
+      } else if (blocks_[id].code > 0) {
+        ++report_.sharedBlocks;
+        report_.saved += blocks_[id].size;
+        offsets.push_back(std::make_pair(i, blocks_[id].code));
+      } else {
+        const uint32_t begin = assembler_.codeSize();
+        const uint32_t code = compileSimple(k->child,
+            nodeType == NodeTypes::kAnd
+            ? ExecutionMode::kAnd : ExecutionMode::kOr);
+        //blocks_ may have grown meanwhile.
+        blocks_[id].code = code;
+        blocks_[id].size = assembler_.codeSize() - begin;
+        ++report_.blocks;
+        offsets.push_back(std::make_pair(i, code));
+      }
+      ids.push_back(id);
     }
-    i = j;
-    if (i != NULL) { j = i->next; }
   }
 
-  i = n;
-  j = i->next;
-
   const uint32_t e = assembler_.codeSize();
   Offsets::const_iterator it = offsets.begin();
+  Ids::const_iterator s = ids.begin();
+  bool negated = false;
 
-  while (i != NULL) {
+  for (Nodes::const_iterator l = nodes.begin(); l != END; ++l) {
+    const Node * const i = *l,
+          * const j = l + 1 != END ? *(l + 1) : NULL;
     const int nodeType = i->type();
     if (i->hasChild()) {
       ASSERT(it != offsets.end());
@@ -65,22 +383,625 @@ uint32_t Compiler::compileSimple(const Node * const n) {
       default: ASSERT(false); break; //unrecheable
       }
 
-      PushExecute(assembler_, m, it->second);
+      ASSERT(s != ids.end());
+      if (pure_[*s] && blocks_[*s].execute > 0) {
+        //the block ran under this same kExecute before, so does its memo.
+        assembler_.pushExecuteSingle(blocks_[*s].execute);
+      } else {
+        if (pure_[*s]) {
+          blocks_[*s].execute = assembler_.codeSize();
+        }
+        PushExecute(assembler_, m, it->second);
+      }
       ++it;
+      ++s;
     } else {
       switch (nodeType) {
       case NodeTypes::kNot: PushNot(assembler_); break;
-      case NodeTypes::kOp: dispatch(i); break;
+      case NodeTypes::kOp:
+        if ( ! negated && fuse(i, j, m)) {
+          //the comparison was folded into the fused instruction.
+          ASSERT(j != NULL);
+          ++l;
+        } else {
+          dispatch(i);
+        }
+        break;
       default: ASSERT(false); break; //unrecheable
       }
     }
-    i = j;
-    if (i != NULL) { j = i->next; }
+    negated = nodeType == NodeTypes::kNot;
   }
   PushReturn(assembler_);
   return e;
 }
 
+static inline bool IsPrint(const Node * const n) {
+  const Op * const o = dynamic_cast< const Op * const >(n);
+  return o != NULL && (o->name == "printError" || o->name == "printDebug");
+}
+
+/*
+ * Interns a node, nested lists included, by its name and parameters or by
+ * the ids of its children. Prints have side effects that must happen at
+ * every call site, so anything containing one is not pure.
+ */
+uint32_t Compiler::cons(const Node * const n) {
+  ASSERT(n != NULL);
+  const Ids::const_iterator it = ids_.find(n);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+
+  std::stringstream ss;
+  ss << n->type();
+  bool pure = true;
+
+  const Op * const o = dynamic_cast< const Op * const >(n);
+  if (o != NULL) {
+    pure = ! IsPrint(o);
+    ss << o->name << "(";
+    const Op::Parameters::const_iterator END = o->parameters.end();
+    for (Op::Parameters::const_iterator it = o->parameters.begin();
+        it != END; ++it) {
+      ss << it->size() << ":" << *it;
+    }
+    ss << ")";
+  }
+
+  if (n->hasChild()) {
+    const BinaryNode * const b = dynamic_cast< const BinaryNode * >(n);
+    ASSERT(b != NULL);
+    ss << "[";
+    for (const Node * i = b->child; i != NULL; i = i->next) {
+      const uint32_t id = cons(i);
+      pure = pure && pure_[id];
+      ss << id << ",";
+    }
+    ss << "]";
+  }
+
+  const std::pair< Conses::iterator, bool > r =
+    conses_.insert(std::make_pair(ss.str(), pure_.size()));
+  if (r.second) {
+    pure_.push_back(pure);
+    blocks_.push_back(Block());
+  }
+  ids_[n] = r.first->second;
+  return r.first->second;
+}
+
+/*
+ * Lowers a list inline. The Result register always holds the value of the
+ * last item, so an And list jumps to its end on the first false and an Or
+ * list on the first true, which is exactly where kExecute would have
+ * stopped. A Not over a nested list becomes a kFlip after it, a trailing
+ * Not has no item to apply to and is dropped.
+ */
+void Compiler::compileJumps(const Node * const n,
+    const ExecutionMode::MODES m) {
+  ASSERT(n != NULL);
+  typedef std::vector< uint32_t > Jumps;
+  Jumps jumps;
+
+  Nodes nodes;
+  order(n, m, nodes);
+  merge(m, nodes);
+  const Nodes::const_iterator END = nodes.end();
+
+  //something reads the register before any item writes to it.
+  if (m != ExecutionMode::kNone) {
+    Nodes::const_iterator l = nodes.begin();
+    while (l != END && (*l)->type() == NodeTypes::kNot) {
+      ++l;
+    }
+    if (l == END || IsPrint(*l)) {
+      if (m == ExecutionMode::kAnd) {
+        PushTrue(assembler_);
+      } else {
+        PushFalse(assembler_);
+      }
+    }
+  }
+
+  bool negated = false;
+
+  for (Nodes::const_iterator l = nodes.begin(); l != END; ++l) {
+    const Node * const i = *l,
+          * const j = l + 1 != END ? *(l + 1) : NULL;
+    const int nodeType = i->type();
+    bool item = true;
+
+    switch (nodeType) {
+    case NodeTypes::kNot:
+      negated = true;
+      item = false;
+      break;
+
+    case NodeTypes::kAnd:
+    case NodeTypes::kOr:
+      {
+        const BinaryNode * k = dynamic_cast< const BinaryNode * >(i);
+        ASSERT(k != NULL);
+        ASSERT(k->child != NULL);
+        compileJumps(k->child, nodeType == NodeTypes::kAnd
+            ? ExecutionMode::kAnd : ExecutionMode::kOr);
+        if (negated) {
+          assembler_.pushFlip();
+          negated = false;
+        }
+      }
+      break;
+
+    case NodeTypes::kOp:
+      if (IsPrint(i)) {
+        dispatch(i);
+        item = false;
+      } else if (negated) {
+        PushNot(assembler_);
+        dispatch(i);
+        negated = false;
+      } else if (fuse(i, j, m)) {
+        //the comparison was folded into the fused instruction.
+        ASSERT(j != NULL);
+        ++l;
+      } else {
+        dispatch(i);
+      }
+      break;
+
+    default: ASSERT(false); break; //unrecheable
+    }
+
+    if (item && l + 1 != END && m != ExecutionMode::kNone) {
+      jumps.push_back(assembler_.codeSize());
+      if (m == ExecutionMode::kAnd) {
+        assembler_.pushJumpIfFalse(0);
+      } else {
+        assembler_.pushJumpIfTrue(0);
+      }
+    }
+  }
+
+  const uint32_t end = assembler_.codeSize();
+  const Jumps::const_iterator JEND = jumps.end();
+  for (Jumps::const_iterator it = jumps.begin(); it != JEND; ++it) {
+    assembler_.patch(*it, end);
+  }
+}
+
+struct Fusion {
+  const char * const exists;
+  const char * const compare;
+  void (*push) (Assembler &, const Op::Parameters &,
+      const ExecutionMode::MODES);
+};
+
+static const Fusion * Fusable(const Node * const n, const Node * const m) {
+  ASSERT(n != NULL);
+  if (m == NULL || n->type() != NodeTypes::kOp
+      || m->type() != NodeTypes::kOp) {
+    return NULL;
+  }
+
+  const Op * const a = dynamic_cast< const Op * const >(n),
+        * const b = dynamic_cast< const Op * const >(m);
+  ASSERT(a != NULL);
+  ASSERT(b != NULL);
+
+  if (a->parameters.size() != 1
+      || b->parameters.size() != 2
+      || a->parameters[0] != b->parameters[0]) {
+    return NULL;
+  }
+
+  static const Fusion x [] = {
+    { "existsQueryParameter", "containsQueryParameter", &Compiler::PushExistsContainsQueryParameter },
+    { "existsQueryParameter", "equalQueryParameter", &Compiler::PushExistsEqualQueryParameter },
+    { "existsQueryParameter", "greaterThanQueryParameter", &Compiler::PushExistsGreaterThanQueryParameter },
+    { "existsQueryParameter", "lessThanQueryParameter", &Compiler::PushExistsLessThanQueryParameter },
+    { "existsQueryParameter", "startsWithQueryParameter", &Compiler::PushExistsStartsWithQueryParameter },
+    { "existsHeader", "containsHeader", &Compiler::PushExistsContainsHeader },
+    { "existsHeader", "equalHeader", &Compiler::PushExistsEqualHeader },
+    { "existsHeader", "greaterThanHeader", &Compiler::PushExistsGreaterThanHeader },
+    { "existsHeader", "lessThanHeader", &Compiler::PushExistsLessThanHeader },
+    { "existsHeader", "startsWithHeader", &Compiler::PushExistsStartsWithHeader },
+    { "existsCookie", "containsCookie", &Compiler::PushExistsContainsCookie },
+    { "existsCookie", "equalCookie", &Compiler::PushExistsEqualCookie },
+    { "existsCookie", "greaterThanCookie", &Compiler::PushExistsGreaterThanCookie },
+    { "existsCookie", "lessThanCookie", &Compiler::PushExistsLessThanCookie },
+  };
+
+  for (size_t i = 0; i < ARRAY_SIZE(x); ++i) {
+    if (a->name == x[i].exists && b->name == x[i].compare) {
+      return &x[i];
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Peephole: existsX(name) immediately followed by a comparison on the same
+ * name compiles into a single fused instruction.
+ */
+bool Compiler::fuse(const Node * const n, const Node * const m,
+    const ExecutionMode::MODES e) {
+  const Fusion * const f = Fusable(n, m);
+  if (f == NULL) {
+    return false;
+  }
+  const Op * const b = dynamic_cast< const Op * const >(m);
+  ASSERT(b != NULL);
+  (*(f->push))(assembler_, b->parameters, e);
+  return true;
+}
+
+struct Many {
+  const char * const name;
+  const Opcodes::OPCODES op;
+  const bool named;
+};
+
+/*
+ * The target of a contains predicate: which kContainsMany opcode, the
+ * name it looks up, if any, and the needle.
+ */
+static bool Targeted(const Node * const n, Opcodes::OPCODES & op,
+    std::string & name, std::string & needle) {
+  const Op * const o = dynamic_cast< const Op * const >(n);
+  if (o == NULL) {
+    return false;
+  }
+
+  static const Many x [] = {
+    { "containsCookie", Opcodes::kContainsManyCookie, true },
+    { "containsDomain", Opcodes::kContainsManyDomain, false },
+    { "containsHeader", Opcodes::kContainsManyHeader, true },
+    { "containsPath", Opcodes::kContainsManyPath, false },
+    { "containsQueryParameter", Opcodes::kContainsManyQueryParameter, true },
+  };
+
+  for (size_t i = 0; i < ARRAY_SIZE(x); ++i) {
+    if (o->name == x[i].name
+        && o->parameters.size() == (x[i].named ? 2u : 1u)) {
+      op = x[i].op;
+      name = x[i].named ? o->parameters[0] : std::string();
+      //header names are looked up folded.
+      if (op == Opcodes::kContainsManyHeader) {
+        name = util::Fold(name);
+      }
+      needle = o->parameters.back();
+      return ! needle.empty();
+    }
+  }
+  return false;
+}
+
+static inline std::string TargetKey(const Opcodes::OPCODES op,
+    const std::string & name) {
+  std::stringstream ss;
+  ss << op << ":" << name;
+  return ss.str();
+}
+
+void Compiler::collect(const Node * n) {
+  for (; n != NULL; n = n->next) {
+    if (n->hasChild()) {
+      const BinaryNode * const b = dynamic_cast< const BinaryNode * >(n);
+      ASSERT(b != NULL);
+      collect(b->child);
+      continue;
+    }
+    Opcodes::OPCODES op = Opcodes::kNull;
+    std::string name, needle;
+    if (Targeted(n, op, name, needle)) {
+      Target & t = targets_[TargetKey(op, name)];
+      t.op = op;
+      t.name = name;
+      t.needles.insert(std::make_pair(needle, 0));
+    }
+  }
+}
+
+//builds and stores an automaton for every target with enough needles.
+void Compiler::automata(void) {
+  Targets::iterator it = targets_.begin();
+  while (it != targets_.end()) {
+    Target & t = it->second;
+    if (t.needles.size() < kMinimumNeedles) {
+      targets_.erase(it++);
+      continue;
+    }
+
+    std::vector< std::string > needles;
+    needles.reserve(t.needles.size());
+    typedef std::map< std::string, uint32_t >::iterator Iterator;
+    for (Iterator n = t.needles.begin(); n != t.needles.end(); ++n) {
+      n->second = needles.size();
+      needles.push_back(n->first);
+    }
+
+    std::vector< uint32_t > words;
+    Automaton::Build(needles, words);
+    t.automaton = assembler_.pushBlob(words);
+    ++it;
+  }
+}
+
+bool Compiler::many(const Node * const n) {
+  Opcodes::OPCODES op = Opcodes::kNull;
+  std::string name, needle;
+  if ( ! Targeted(n, op, name, needle)) {
+    return false;
+  }
+  const Targets::const_iterator it = targets_.find(TargetKey(op, name));
+  if (it == targets_.end()) {
+    return false;
+  }
+  const std::map< std::string, uint32_t >::const_iterator k =
+    it->second.needles.find(needle);
+  //appended trees may search for needles the automaton lacks.
+  if (k == it->second.needles.end()) {
+    return false;
+  }
+  assembler_.pushContainsMany(op, name.empty() ? NULL : name.c_str(),
+      it->second.automaton, k->second);
+  return true;
+}
+
+struct Family {
+  const char * const name;
+  const Opcodes::OPCODES op;
+};
+
+/*
+ * An Or list free of prints is true as soon as any of its items is, so
+ * its equalDomain items, or its equalPath ones, can be answered by a
+ * single hash set lookup standing where the first of them was.
+ */
+void Compiler::merge(const ExecutionMode::MODES m, Nodes & r) {
+  if ( ! (flags_ & CompilerFlags::kSets) || m != ExecutionMode::kOr) {
+    return;
+  }
+
+  const Nodes::const_iterator END = r.end();
+  for (Nodes::const_iterator it = r.begin(); it != END; ++it) {
+    if ((*it)->type() != NodeTypes::kNot && ! pure_[cons(*it)]) {
+      return;
+    }
+  }
+
+  static const Family x [] = {
+    { "equalDomain", Opcodes::kEqualDomainSet },
+    { "equalPath", Opcodes::kEqualPathSet },
+  };
+
+  std::vector< bool > merged(r.size(), false);
+  bool any = false;
+
+  for (size_t i = 0; i < ARRAY_SIZE(x); ++i) {
+    std::vector< uint32_t > items;
+    std::set< std::string > strings;
+    for (uint32_t k = 0; k < r.size(); ++k) {
+      const Op * const o = dynamic_cast< const Op * const >(r[k]);
+      if (o != NULL && o->name == x[i].name && o->parameters.size() == 1
+          && (k == 0 || r[k - 1]->type() != NodeTypes::kNot)) {
+        items.push_back(k);
+        strings.insert(o->parameters[0]);
+      }
+    }
+    if (items.size() < kMinimumSet) {
+      continue;
+    }
+
+    std::stringstream key;
+    key << x[i].op << ":";
+    const std::set< std::string >::const_iterator SEND = strings.end();
+    for (std::set< std::string >::const_iterator s = strings.begin();
+        s != SEND; ++s) {
+      key << s->size() << ":" << *s;
+    }
+
+    const std::pair< Tables::iterator, bool > t =
+      tables_.insert(std::make_pair(key.str(), 0));
+    if (t.second) {
+      std::vector< uint32_t > words;
+      HashSet::Build(std::vector< std::string >(strings.begin(), SEND),
+          words);
+      t.first->second = assembler_.pushBlob(words);
+    }
+
+    sets_[r[items[0]]] = Set(x[i].op, t.first->second);
+    for (uint32_t k = 1; k < items.size(); ++k) {
+      merged[items[k]] = true;
+    }
+    any = true;
+  }
+
+  if (any) {
+    Nodes s;
+    s.reserve(r.size());
+    for (uint32_t k = 0; k < r.size(); ++k) {
+      if ( ! merged[k]) {
+        s.push_back(r[k]);
+      }
+    }
+    r.swap(s);
+  }
+}
+
+struct Unit {
+  double rank;
+  uint32_t begin;
+  uint32_t end;
+  Unit(const double r, const uint32_t b, const uint32_t e) :
+    rank(r), begin(b), end(e) { }
+  inline bool operator < (const Unit & u) const { return rank < u.rank; }
+};
+
+/*
+ * The nodes of a list in the order they are compiled. And / Or lists free
+ * of prints give the same result in any order, so under kReorder cheaper
+ * items go first and the expensive ones only run when the cheap ones did
+ * not short-circuit, see rank. A Not stays with its item and a fusable
+ * pair stays together. A trailing Not applies past the list, which keeps
+ * its order.
+ */
+void Compiler::order(const Node * const n, const ExecutionMode::MODES m,
+    Nodes & r) {
+  ASSERT(n != NULL);
+  for (const Node * i = n; i != NULL; i = i->next) {
+    r.push_back(i);
+  }
+
+  if ( ! (flags_ & CompilerFlags::kReorder) || m == ExecutionMode::kNone) {
+    return;
+  }
+
+  typedef std::vector< Unit > Units;
+  Units units;
+  uint32_t begin = 0;
+
+  for (uint32_t k = 0; k < r.size(); ++k) {
+    const Node * const i = r[k];
+    if (i->type() == NodeTypes::kNot) {
+      continue;
+    }
+    if ( ! pure_[cons(i)]) {
+      return;
+    }
+    if (k + 1 < r.size() && Fusable(i, r[k + 1]) != NULL) {
+      ++k;
+    }
+    units.push_back(Unit(rank(r, begin, k + 1, m), begin, k + 1));
+    begin = k + 1;
+  }
+
+  if (begin != r.size()) {
+    return;
+  }
+
+  std::stable_sort(units.begin(), units.end());
+
+  Nodes s;
+  s.reserve(r.size());
+  const Units::const_iterator END = units.end();
+  for (Units::const_iterator it = units.begin(); it != END; ++it) {
+    s.insert(s.end(), r.begin() + it->begin, r.begin() + it->end);
+  }
+  r.swap(s);
+}
+
+/*
+ * Expected cost of an item before the list short-circuits: its cost over
+ * the chance it short-circuits, one half unless the profile measured it.
+ */
+double Compiler::rank(const Nodes & r, const uint32_t begin,
+    const uint32_t end, const ExecutionMode::MODES m) const {
+  uint32_t k = begin;
+  bool negated = false;
+  for (; r[k]->type() == NodeTypes::kNot; ++k) {
+    negated = ! negated;
+  }
+  ASSERT(k < end);
+
+  const Node * const i = r[k],
+        * const j = ! negated && k + 1 < end ? r[k + 1] : NULL;
+  const double c = cost(i);
+  double p = 0.5;
+
+  if (profile_ != NULL && i->type() == NodeTypes::kOp) {
+    const Counter * const t = profile_->find(Key(i, j, m));
+    if (t != NULL && t->executions > 0) {
+      const double trues = static_cast< double >(t->trues) / t->executions;
+      //an And stops on false, an Or on true, a Not swaps them.
+      p = (m == ExecutionMode::kAnd) != negated ? 1 - trues : trues;
+    }
+  }
+
+  if (c == 0) {
+    return 0;
+  }
+  return p > 0 ? c / p : std::numeric_limits< double >::max();
+}
+
+//the profile key of an op, or of the fused instruction it makes with m.
+std::string Compiler::Key(const Node * const n, const Node * const m,
+    const ExecutionMode::MODES e) {
+  Assembler a;
+  const Fusion * const f = m != NULL ? Fusable(n, m) : NULL;
+  if (f != NULL) {
+    const Op * const b = dynamic_cast< const Op * const >(m);
+    ASSERT(b != NULL);
+    (*(f->push))(a, b->parameters, e);
+  } else {
+    Dispatch(a, n);
+  }
+  const Program p(a.code(), a.memory());
+  return Profile::Key(p, p[p.size() - 1]);
+}
+
+//a nested list costs as much as all its items.
+uint32_t Compiler::cost(const Node * const n) const {
+  ASSERT(n != NULL);
+  if (n->hasChild()) {
+    const BinaryNode * const b = dynamic_cast< const BinaryNode * >(n);
+    ASSERT(b != NULL);
+    uint32_t c = 0;
+    for (const Node * i = b->child; i != NULL; i = i->next) {
+      c += cost(i);
+    }
+    return c;
+  }
+
+  const Op * const o = dynamic_cast< const Op * const >(n);
+  if (o == NULL) {
+    return 0;
+  }
+
+  const Costs::const_iterator it = costs_.find(o->name);
+  return it != costs_.end() ? it->second : Cost(o->name);
+}
+
+struct Suffix {
+  const char * const suffix;
+  const uint32_t cost;
+};
+
+/*
+ * Relative cost of a predicate by what it reads: method and scheme, then
+ * domain and path, headers, the query string and cookies, which are parsed
+ * first. Numeric comparisons parse their value on top of that.
+ */
+uint32_t Compiler::Cost(const std::string & n) {
+  static const Suffix x [] = {
+    { "Method", 1 },
+    { "Scheme", 1 },
+    { "Domain", 2 },
+    { "Path", 2 },
+    { "Header", 4 },
+    { "HeaderI", 4 },
+    { "QueryParameter", 8 },
+    { "Cookie", 16 },
+  };
+
+  uint32_t c = 0;
+  for (size_t i = 0; i < ARRAY_SIZE(x); ++i) {
+    const size_t l = strlen(x[i].suffix);
+    if (n.size() > l && n.compare(n.size() - l, l, x[i].suffix) == 0) {
+      c = x[i].cost;
+      break;
+    }
+  }
+
+  if (n.compare(0, 11, "greaterThan") == 0
+      || n.compare(0, 8, "lessThan") == 0) {
+    c += 32;
+  }
+  return c;
+}
+
 struct X {
   const char * const a;
   void (*b) (Assembler &, const Op::Parameters &);
@@ -92,7 +1013,7 @@ struct X {
   }
 };
 
-void Compiler::dispatch(const Node * const n) {
+void Compiler::Dispatch(Assembler & a, const Node * const n) {
   ASSERT(n != NULL);
   ASSERT(n->type() > NodeTypes::kUndefined);
   ASSERT(n->type() < NodeTypes::kUpperBound);
@@ -103,11 +1024,13 @@ void Compiler::dispatch(const Node * const n) {
     { "containsCookie", &Compiler::PushContainsCookie },
     { "containsDomain", &Compiler::PushContainsDomain },
     { "containsHeader", &Compiler::PushContainsHeader },
+    { "containsHeaderI", &Compiler::PushContainsHeaderI },
     { "containsPath", &Compiler::PushContainsPath },
     { "containsQueryParameter", &Compiler::PushContainsQueryParameter },
     { "equalCookie", &Compiler::PushEqualCookie },
     { "equalDomain", &Compiler::PushEqualDomain },
     { "equalHeader", &Compiler::PushEqualHeader },
+    { "equalHeaderI", &Compiler::PushEqualHeaderI },
     { "equalPath", &Compiler::PushEqualPath },
     { "equalQueryParameter", &Compiler::PushEqualQueryParameter },
     { "existsCookie", &Compiler::PushExistsCookie },
@@ -131,6 +1054,7 @@ void Compiler::dispatch(const Node * const n) {
     { "notEqualCookie", &Compiler::PushNotEqualCookie },
     { "notEqualDomain", &Compiler::PushNotEqualDomain },
     { "notEqualHeader", &Compiler::PushNotEqualHeader },
+    { "notEqualHeaderI", &Compiler::PushNotEqualHeaderI },
     { "notEqualPath", &Compiler::PushNotEqualPath },
     { "notEqualQueryParameter", &Compiler::PushNotEqualQueryParameter },
     { "printDebug", &Compiler::PushPrintDebug },
@@ -150,7 +1074,7 @@ void Compiler::dispatch(const Node * const n) {
   ASSERT(i >= begin);
 
   if (i < end && *i == o->name) {
-    (*(i->b))(assembler_, o->parameters);
+    (*(i->b))(a, o->parameters);
   } else {
     std::cerr << o->name << "\n";
     ASSERT(false); //unsupported.
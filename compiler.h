@@ -7,36 +7,228 @@
 #ifndef COMPILER_H
 #define COMPILER_H
 
+#include <map>
+#include <ostream>
+#include <string>
 #include <vector>
 
 #include "my-assert.h"
 
 #include "assembler.h"
+#include "diagram.h"
+#include "profile.h"
 #include "representation.h"
+#include "requirements.h"
 
 namespace http {
 namespace filters {
-typedef std::vector< uint32_t > Offsets;
+
+struct CompilerFlags {
+  enum FLAGS {
+    kNone = 0,
+
+    /*
+     * lowers And / Or lists into conditional jumps inline, instead of
+     * kExecute / kReturn pairs, so evaluation never touches the stack.
+     */
+    kJumps = 1 << 0,
+
+    /*
+     * evaluates cheaper predicates first inside And / Or lists, see
+     * Compiler::order.
+     */
+    kReorder = 1 << 1,
+
+    /*
+     * compiles the contains predicates of a forest on the same target
+     * against a single automaton, see kContainsMany.
+     */
+    kAutomata = 1 << 2,
+
+    /*
+     * compiles the equalDomain and equalPath items of an Or list into a
+     * single lookup in a hash set, see kEqualDomainSet.
+     */
+    kSets = 1 << 3,
+
+    /*
+     * runs the Optimizer once the forest is compiled.
+     */
+    kOptimize = 1 << 4,
+  };
+};
+
+/*
+ * What sharing saved while compiling.
+ */
+struct CompilerReport {
+  uint32_t entries;
+  uint32_t sharedEntries;
+  uint32_t blocks;
+  uint32_t sharedBlocks;
+  uint32_t saved; //instructions not emitted thanks to sharing.
+  uint32_t optimized; //instructions the Optimizer removed.
+  uint32_t compacted; //instructions compact removed.
+
+  CompilerReport(void) : entries(0), sharedEntries(0), blocks(0),
+    sharedBlocks(0), saved(0), optimized(0), compacted(0) { }
+};
 
 struct Compiler {
-  Assembler assembler_;
+  /*
+   * A nested list compiled once: the address of its code, of the first
+   * kExecute calling it and how many instructions it took. Zero until set.
+   */
+  struct Block {
+    uint32_t code;
+    uint32_t execute;
+    uint32_t size;
+    Block(void) : code(0), execute(0), size(0) { }
+  };
+
+  typedef std::map< std::string, uint32_t > Conses;
+  typedef std::map< const Node *, uint32_t > Ids;
+  typedef std::vector< Block > Blocks;
+  typedef std::pair< uint32_t, uint32_t > Entry;
+  typedef std::map< std::string, Entry > Entries;
+  typedef std::map< std::string, uint32_t > Costs;
+  typedef std::vector< const Node * > Nodes;
+
+  /*
+   * contains predicates sharing an opcode and a name, and the automaton
+   * their needles were collected into.
+   */
+  struct Target {
+    Opcodes::OPCODES op;
+    std::string name;
+    uint32_t automaton;
+    std::map< std::string, uint32_t > needles;
+    Target(void) : op(Opcodes::kNull), automaton(0) { }
+  };
+
+  typedef std::map< std::string, Target > Targets;
+
+  //fewer needles than this are not worth an automaton.
+  static const uint32_t kMinimumNeedles = 2;
+
+  //the item standing for a merged set, its opcode and its table.
+  typedef std::pair< Opcodes::OPCODES, uint32_t > Set;
+  typedef std::map< const Node *, Set > Sets;
+  typedef std::map< std::string, uint32_t > Tables;
+
+  //fewer comparisons than this are not worth a hash set.
+  static const uint32_t kMinimumSet = 4;
+
+  //diagram variable of each predicate, by cons id.
+  typedef std::map< uint32_t, uint32_t > Variables;
+  typedef std::map< uint32_t, uint32_t > Addresses;
+
+  //past this many vertices compileDiagram gives up.
+  static const uint32_t kMaximumVertices = 1 << 16;
 
-  Compiler(void);
+  Assembler assembler_;
+  const uint32_t flags_;
+
+  /*
+   * hash-consing: every distinct subtree of the forest, by structure, gets
+   * a dense id. ids_ caches them for the nodes of the tree being compiled.
+   */
+  Conses conses_;
+  Ids ids_;
+  //per id, whether the subtree is free of prints.
+  std::vector< bool > pure_;
+  //per id, where a pure nested list was compiled.
+  Blocks blocks_;
+  //entries already compiled, by the ids of their top level nodes.
+  Entries entries_;
+  CompilerReport report_;
+  //overrides the default cost of a predicate, by name.
+  Costs costs_;
+  //measured selectivity to order by under kReorder, optional.
+  const Profile * profile_;
+  Targets targets_;
+  Sets sets_;
+  //hash sets already stored, by opcode and contents.
+  Tables tables_;
+  //what each entry compiled by compile(const Forest &, ...) reads.
+  Requirements requirements_;
+  //what removed entries run, always false. Zero until one is removed.
+  uint32_t tombstone_;
+
+  Compiler(const uint32_t f = CompilerFlags::kNone);
 
   void compile(const Forest &, Offsets &);
 
-  inline uint32_t compile(const Tree & t) {
-    if (t.root() == NULL) {
-      return 0;
+  uint32_t compile(const Tree &);
+
+  bool compileDiagram(const Forest &, uint32_t &);
+
+  void optimize(Offsets &);
+
+  /*
+   * incremental changes to a compiled forest: entries keep their index in
+   * Offsets, only compact moves their addresses.
+   */
+  uint32_t append(const Tree &, Offsets &);
+
+  void remove(const uint32_t, Offsets &);
+
+  void compact(Offsets &);
+
+  uint32_t function(Diagram &, const Node *, const ExecutionMode::MODES,
+      const Variables &);
+
+  uint32_t emit(const Diagram &, const uint32_t, const Nodes &,
+      Addresses &);
+
+  uint32_t compileSimple(const Node *,
+      const ExecutionMode::MODES m = ExecutionMode::kNone);
+
+  void compileJumps(const Node *,
+      const ExecutionMode::MODES m = ExecutionMode::kNone);
+
+  inline void dispatch(const Node * const n) {
+    if ( ! sets_.empty()) {
+      const Sets::iterator it = sets_.find(n);
+      if (it != sets_.end()) {
+        assembler_.pushEqualSet(it->second.first, it->second.second);
+        sets_.erase(it);
+        return;
+      }
+    }
+    if (targets_.empty() || ! many(n)) {
+      Dispatch(assembler_, n);
     }
-    const uint32_t result = compileSimple(t.root());
-    assembler_.pushHalt();
-    return result;
   }
 
-  uint32_t compileSimple(const Node *);
+  void merge(const ExecutionMode::MODES, Nodes &);
+
+  void collect(const Node *);
+
+  void automata(void);
 
-  void dispatch(const Node * const);
+  bool many(const Node * const);
+
+  static void Dispatch(Assembler &, const Node * const);
+
+  uint32_t cons(const Node * const);
+
+  void order(const Node * const, const ExecutionMode::MODES, Nodes &);
+
+  uint32_t cost(const Node * const) const;
+
+  double rank(const Nodes &, const uint32_t, const uint32_t,
+      const ExecutionMode::MODES) const;
+
+  static std::string Key(const Node * const, const Node * const,
+      const ExecutionMode::MODES);
+
+  static uint32_t Cost(const std::string &);
+
+  void report(std::ostream &) const;
+
+  bool fuse(const Node * const, const Node * const,
+      const ExecutionMode::MODES);
 
   static inline void PushAnd(Assembler & a,
       const Op::Parameters & o = Op::Parameters()) { a.pushAnd(); }
@@ -265,6 +457,24 @@ struct Compiler {
     a.pushStartsWithHeader(p[0].c_str(), p[1].c_str(), 0);
   }
 
+  static inline void PushContainsHeaderI(Assembler & a,
+      const Op::Parameters & p) {
+    ASSERT(p.size() == 2);
+    a.pushContainsHeaderI(p[0].c_str(), p[1].c_str());
+  }
+
+  static inline void PushEqualHeaderI(Assembler & a,
+      const Op::Parameters & p) {
+    ASSERT(p.size() == 2);
+    a.pushEqualHeaderI(p[0].c_str(), p[1].c_str());
+  }
+
+  static inline void PushNotEqualHeaderI(Assembler & a,
+      const Op::Parameters & p) {
+    ASSERT(p.size() == 2);
+    a.pushNotEqualHeaderI(p[0].c_str(), p[1].c_str());
+  }
+
   static inline void PushStartsWithQueryParameter(Assembler & a,
       const Op::Parameters & p) {
     ASSERT(p.size() == 2);
@@ -272,6 +482,90 @@ struct Compiler {
         0);
   }
 
+  static inline void PushExistsContainsQueryParameter(Assembler & a,
+      const Op::Parameters & p, const ExecutionMode::MODES m) {
+    ASSERT(p.size() == 2);
+    a.pushExistsContainsQueryParameter(p[0].c_str(), p[1].c_str(), m);
+  }
+
+  static inline void PushExistsEqualQueryParameter(Assembler & a,
+      const Op::Parameters & p, const ExecutionMode::MODES m) {
+    ASSERT(p.size() == 2);
+    a.pushExistsEqualQueryParameter(p[0].c_str(), p[1].c_str(), m);
+  }
+
+  static inline void PushExistsGreaterThanQueryParameter(Assembler & a,
+      const Op::Parameters & p, const ExecutionMode::MODES m) {
+    ASSERT(p.size() == 2);
+    a.pushExistsGreaterThanQueryParameter(p[0].c_str(), atoi(p[1].c_str()), m);
+  }
+
+  static inline void PushExistsLessThanQueryParameter(Assembler & a,
+      const Op::Parameters & p, const ExecutionMode::MODES m) {
+    ASSERT(p.size() == 2);
+    a.pushExistsLessThanQueryParameter(p[0].c_str(), atoi(p[1].c_str()), m);
+  }
+
+  static inline void PushExistsStartsWithQueryParameter(Assembler & a,
+      const Op::Parameters & p, const ExecutionMode::MODES m) {
+    ASSERT(p.size() == 2);
+    a.pushExistsStartsWithQueryParameter(p[0].c_str(), p[1].c_str(), m);
+  }
+
+  static inline void PushExistsContainsHeader(Assembler & a,
+      const Op::Parameters & p, const ExecutionMode::MODES m) {
+    ASSERT(p.size() == 2);
+    a.pushExistsContainsHeader(p[0].c_str(), p[1].c_str(), m);
+  }
+
+  static inline void PushExistsEqualHeader(Assembler & a,
+      const Op::Parameters & p, const ExecutionMode::MODES m) {
+    ASSERT(p.size() == 2);
+    a.pushExistsEqualHeader(p[0].c_str(), p[1].c_str(), m);
+  }
+
+  static inline void PushExistsGreaterThanHeader(Assembler & a,
+      const Op::Parameters & p, const ExecutionMode::MODES m) {
+    ASSERT(p.size() == 2);
+    a.pushExistsGreaterThanHeader(p[0].c_str(), atoi(p[1].c_str()), m);
+  }
+
+  static inline void PushExistsLessThanHeader(Assembler & a,
+      const Op::Parameters & p, const ExecutionMode::MODES m) {
+    ASSERT(p.size() == 2);
+    a.pushExistsLessThanHeader(p[0].c_str(), atoi(p[1].c_str()), m);
+  }
+
+  static inline void PushExistsStartsWithHeader(Assembler & a,
+      const Op::Parameters & p, const ExecutionMode::MODES m) {
+    ASSERT(p.size() == 2);
+    a.pushExistsStartsWithHeader(p[0].c_str(), p[1].c_str(), m);
+  }
+
+  static inline void PushExistsContainsCookie(Assembler & a,
+      const Op::Parameters & p, const ExecutionMode::MODES m) {
+    ASSERT(p.size() == 2);
+    a.pushExistsContainsCookie(p[0].c_str(), p[1].c_str(), m);
+  }
+
+  static inline void PushExistsEqualCookie(Assembler & a,
+      const Op::Parameters & p, const ExecutionMode::MODES m) {
+    ASSERT(p.size() == 2);
+    a.pushExistsEqualCookie(p[0].c_str(), p[1].c_str(), m);
+  }
+
+  static inline void PushExistsGreaterThanCookie(Assembler & a,
+      const Op::Parameters & p, const ExecutionMode::MODES m) {
+    ASSERT(p.size() == 2);
+    a.pushExistsGreaterThanCookie(p[0].c_str(), atoi(p[1].c_str()), m);
+  }
+
+  static inline void PushExistsLessThanCookie(Assembler & a,
+      const Op::Parameters & p, const ExecutionMode::MODES m) {
+    ASSERT(p.size() == 2);
+    a.pushExistsLessThanCookie(p[0].c_str(), atoi(p[1].c_str()), m);
+  }
+
   static inline void PushExecute(Assembler & a, const ExecutionMode::MODES m,
       const uint32_t o, const uint32_t c = 0) {
     ASSERT(m == ExecutionMode::kNone
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#include <algorithm>
+#include <iterator>
+
+#include "diagram.h"
+
+namespace http {
+namespace filters {
+
+const uint32_t Diagram::kTerminal;
+
+uint32_t Diagram::terminal(const Set & s) {
+  const std::pair< Sets::iterator, bool > r =
+    setIds_.insert(std::make_pair(s, sets_.size()));
+  if ( ! r.second) {
+    const Key k(kTerminal, std::make_pair(r.first->second, 0));
+    const Unique::const_iterator it = unique_.find(k);
+    ASSERT(it != unique_.end());
+    return it->second;
+  }
+  sets_.push_back(s);
+  const uint32_t v = vertices_.size();
+  vertices_.push_back(Vertex(kTerminal, r.first->second, 0));
+  unique_.insert(std::make_pair(
+        Key(kTerminal, std::make_pair(r.first->second, 0)), v));
+  return v;
+}
+
+//reduced: equal children skip the test, equal tests are shared.
+uint32_t Diagram::vertex(const uint32_t v, const uint32_t l,
+    const uint32_t h) {
+  ASSERT(v != kTerminal);
+  if (l == h) {
+    return l;
+  }
+  const std::pair< Unique::iterator, bool > r =
+    unique_.insert(std::make_pair(Key(v, std::make_pair(l, h)),
+          vertices_.size()));
+  if (r.second) {
+    if (vertices_.size() >= maximum_) {
+      overflow_ = true;
+    }
+    vertices_.push_back(Vertex(v, l, h));
+  }
+  return r.first->second;
+}
+
+uint32_t Diagram::boolean(const bool b) {
+  return terminal(b ? Set(1, 0) : Set());
+}
+
+uint32_t Diagram::variable(const uint32_t v) {
+  return vertex(v, boolean(false), boolean(true));
+}
+
+uint32_t Diagram::apply(const OPERATIONS o, const uint32_t a,
+    const uint32_t b) {
+  Cache c;
+  return apply(o, a, b, c);
+}
+
+uint32_t Diagram::apply(const OPERATIONS o, const uint32_t a,
+    const uint32_t b, Cache & c) {
+  if (overflow_) {
+    return a;
+  }
+
+  const Vertex & x = (*this)[a], & y = (*this)[b];
+  if (x.variable == kTerminal && y.variable == kTerminal) {
+    const Set & s = sets_[x.low], & t = sets_[y.low];
+    Set r;
+    if (o == kUnion) {
+      std::set_union(s.begin(), s.end(), t.begin(), t.end(),
+          std::back_inserter(r));
+    } else {
+      std::set_intersection(s.begin(), s.end(), t.begin(), t.end(),
+          std::back_inserter(r));
+    }
+    return terminal(r);
+  }
+
+  const Cache::key_type k(a, b);
+  const Cache::const_iterator it = c.find(k);
+  if (it != c.end()) {
+    return it->second;
+  }
+
+  //vertices_ may grow, so nothing below holds a reference into it.
+  const uint32_t v = std::min(x.variable, y.variable);
+  const uint32_t al = x.variable == v ? x.low : a,
+        ah = x.variable == v ? x.high : a,
+        bl = y.variable == v ? y.low : b,
+        bh = y.variable == v ? y.high : b;
+  const uint32_t l = apply(o, al, bl, c), h = apply(o, ah, bh, c);
+  const uint32_t r = vertex(v, l, h);
+  c.insert(std::make_pair(k, r));
+  return r;
+}
+
+uint32_t Diagram::map(const uint32_t a,
+    const std::map< uint32_t, uint32_t > & t,
+    std::map< uint32_t, uint32_t > & c) {
+  if (terminal(a)) {
+    const std::map< uint32_t, uint32_t >::const_iterator it =
+      t.find((*this)[a].low);
+    return it != t.end() ? it->second : a;
+  }
+
+  const std::map< uint32_t, uint32_t >::const_iterator it = c.find(a);
+  if (it != c.end()) {
+    return it->second;
+  }
+
+  const uint32_t v = (*this)[a].variable, l = (*this)[a].low,
+        h = (*this)[a].high;
+  const uint32_t r = vertex(v, map(l, t, c), map(h, t, c));
+  c.insert(std::make_pair(a, r));
+  return r;
+}
+
+uint32_t Diagram::negate(const uint32_t a) {
+  const uint32_t f = boolean(false), t = boolean(true);
+  std::map< uint32_t, uint32_t > m, c;
+  m[(*this)[f].low] = t;
+  m[(*this)[t].low] = f;
+  return map(a, m, c);
+}
+
+uint32_t Diagram::label(const uint32_t a, const uint32_t e) {
+  const uint32_t t = boolean(true), l = terminal(Set(1, e));
+  std::map< uint32_t, uint32_t > m, c;
+  m[(*this)[t].low] = l;
+  return map(a, m, c);
+}
+
+} //end of filters namespace
+} //end of http namespace
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#ifndef DIAGRAM_H
+#define DIAGRAM_H
+
+#include <map>
+#include <vector>
+
+#include <stdint.h>
+
+#include "my-assert.h"
+
+namespace http {
+namespace filters {
+
+/*
+ * Reduced ordered decision diagram whose terminals are sets of entries,
+ * shared by every function built in it. A boolean function has the
+ * terminals {} for false and {0} for true, label turns it into {} and
+ * {entry}, and the union of labeled functions tells, for any assignment of
+ * the variables, which entries are true. Smaller variables are tested
+ * first.
+ */
+struct Diagram {
+  typedef std::vector< uint32_t > Set;
+
+  enum OPERATIONS {
+    kIntersection,
+    kUnion,
+  };
+
+  static const uint32_t kTerminal = 0xFFFFFFFF;
+
+  //a terminal has variable kTerminal and the index of its set in low.
+  struct Vertex {
+    uint32_t variable;
+    uint32_t low;
+    uint32_t high;
+    Vertex(const uint32_t v, const uint32_t l, const uint32_t h) :
+      variable(v), low(l), high(h) { }
+  };
+
+  typedef std::vector< Vertex > Vertices;
+  typedef std::pair< uint32_t, std::pair< uint32_t, uint32_t > > Key;
+  typedef std::map< Key, uint32_t > Unique;
+  typedef std::map< Set, uint32_t > Sets;
+  typedef std::map< std::pair< uint32_t, uint32_t >, uint32_t > Cache;
+
+  Vertices vertices_;
+  Unique unique_;
+  std::vector< Set > sets_;
+  Sets setIds_;
+  //past this many vertices it gives up, see overflow.
+  const uint32_t maximum_;
+  bool overflow_;
+
+  Diagram(const uint32_t m) : maximum_(m), overflow_(false) { }
+
+  inline uint32_t size(void) const { return vertices_.size(); }
+
+  //whether it grew past maximum_, results are meaningless then.
+  inline bool overflow(void) const { return overflow_; }
+
+  inline const Vertex & operator [] (const uint32_t i) const {
+    ASSERT(i < vertices_.size());
+    return vertices_[i];
+  }
+
+  inline bool terminal(const uint32_t i) const {
+    return (*this)[i].variable == kTerminal;
+  }
+
+  inline const Set & set(const uint32_t i) const {
+    ASSERT(terminal(i));
+    return sets_[(*this)[i].low];
+  }
+
+  uint32_t terminal(const Set &);
+
+  uint32_t vertex(const uint32_t, const uint32_t, const uint32_t);
+
+  uint32_t boolean(const bool);
+
+  uint32_t variable(const uint32_t);
+
+  uint32_t apply(const OPERATIONS, const uint32_t, const uint32_t);
+
+  //of a boolean function.
+  uint32_t negate(const uint32_t);
+
+  //of a boolean function, true becomes {e}.
+  uint32_t label(const uint32_t, const uint32_t);
+
+  uint32_t apply(const OPERATIONS, const uint32_t, const uint32_t, Cache &);
+
+  //replaces the terminals of a function, by set index.
+  uint32_t map(const uint32_t, const std::map< uint32_t, uint32_t > &,
+      std::map< uint32_t, uint32_t > &);
+};
+
+} //end of filters namespace
+} //end of http namespace
+
+#endif //DIAGRAM_H
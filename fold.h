@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#ifndef FOLD_H
+#define FOLD_H
+
+#include <string>
+
+#include <cstring>
+
+#include <stdint.h>
+
+namespace util {
+
+/*
+ * ASCII case folding, to lower case. Rules fold what they compare against
+ * when they are compiled. At run time request header names are folded once,
+ * when their map is built, and values as an I predicate compares them, both
+ * eight bytes at a time.
+ */
+static const uint64_t kOnes = 0x0101010101010101ull;
+
+inline char Fold(const char c) {
+  return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+/*
+ * every byte of w folded at once. On the low 7 bits of a byte, adding
+ * 0x80 - 'A' sets the high bit from 'A' on and adding 0x80 - 'Z' - 1 from
+ * past 'Z' on, neither carrying into the next byte; bytes from 0x80 on
+ * are left alone.
+ */
+inline uint64_t Fold(const uint64_t w) {
+  const uint64_t low = w & (kOnes * 0x7F),
+        a = low + kOnes * (0x80 - 'A'),
+        z = low + kOnes * (0x80 - 'Z' - 1),
+        upper = a & ~z & ~w & (kOnes * 0x80);
+  return w | (upper >> 2);
+}
+
+inline std::string Fold(const std::string & s) {
+  std::string r(s);
+  for (std::string::iterator it = r.begin(); it != r.end(); ++it) {
+    *it = Fold(*it);
+  }
+  return r;
+}
+
+//whether the l bytes at p, folded, are the l bytes at q, folded already.
+inline bool EqualFolded(const char * p, const char * q, size_t l) {
+  for (; l >= sizeof(uint64_t);
+      l -= sizeof(uint64_t), p += sizeof(uint64_t), q += sizeof(uint64_t)) {
+    uint64_t a, b;
+    memcpy(&a, p, sizeof(a));
+    memcpy(&b, q, sizeof(b));
+    if (Fold(a) != b) {
+      return false;
+    }
+  }
+  for (; l > 0; --l, ++p, ++q) {
+    if (Fold(*p) != *q) {
+      return false;
+    }
+  }
+  return true;
+}
+
+//the l bytes at p, folded, into r.
+inline void Fold(const char * p, size_t l, std::string & r) {
+  r.resize(l);
+  for (size_t i = 0; l - i >= sizeof(uint64_t); i += sizeof(uint64_t)) {
+    uint64_t w;
+    memcpy(&w, p + i, sizeof(w));
+    w = Fold(w);
+    memcpy(&r[i], &w, sizeof(w));
+  }
+  for (size_t i = l - l % sizeof(uint64_t); i < l; ++i) {
+    r[i] = Fold(p[i]);
+  }
+}
+
+} //end of util namespace
+
+#endif //FOLD_H
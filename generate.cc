@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#include <iostream>
+
+#include "generator.h"
+#include "representation.h"
+#include "rules.h"
+
+/*
+ * Writes the ahead of time translation of the plugin rules to stdout.
+ */
+int main(void) {
+  using namespace http::filters;
+  Forest f;
+  BuildRules(f);
+
+  Generator g("Rules");
+  g.generate(f, std::cout);
+
+  cleanAll(f);
+  return 0;
+}
@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "fold.h"
+#include "generator.h"
+
+namespace http {
+namespace filters {
+
+struct Arguments {
+  enum KINDS {
+    kNull,
+    kLength, //(a, length)
+    kLengthOffset, //(a, length, 0)
+    kName, //(a)
+    kPair, //(a, b)
+    kPairOffset, //(a, b, 0)
+    kPairFolded, //(a, b in lower case)
+    kNumber, //(a, number)
+    kPairNumber, //(a, b, number)
+  };
+};
+
+struct Y {
+  const char * const a;
+  const char * const b;
+  const Arguments::KINDS c;
+  inline bool operator < (const std::string & n) const {
+    return strcmp(a, n.c_str()) < 0;
+  }
+  inline bool operator == (const std::string & n) const {
+    return strcmp(a, n.c_str()) == 0;
+  }
+};
+
+void Generator::generate(const Forest & f, std::ostream & o) {
+  lists_.str("");
+  counter_ = 0;
+
+  std::stringstream entries;
+  for (size_t i = 0; i < f.size(); ++i) {
+    entries << "  inline bool entry" << i << "(void) {" "\n"
+      << entry(f[i])
+      << "  }" "\n\n";
+  }
+
+  o << "/*" "\n"
+    " * generated from " << f.size() << " entries, do not edit." "\n"
+    " */" "\n\n"
+    "#include <stdint.h>" "\n\n"
+    "#include \"my-assert.h\"" "\n\n"
+    "namespace http {" "\n"
+    "namespace filters {" "\n\n"
+    "template < class I >" "\n"
+    "struct " << name_ << " {" "\n"
+    "  static const uint32_t kEntries = " << f.size() << ";" "\n\n"
+    "  I & i_;" "\n"
+    "  bool r_;" "\n\n"
+    "  " << name_ << "(I & i) : i_(i), r_(true) { }" "\n\n"
+    << lists_.str()
+    << entries.str()
+    << "  inline bool run(const uint32_t e) {" "\n"
+    "    switch (e) {" "\n";
+
+  for (size_t i = 0; i < f.size(); ++i) {
+    o << "    case " << i << ": return entry" << i << "();" "\n";
+  }
+
+  o << "    default: ASSERT(false); return false; //unrecheable" "\n"
+    "    }" "\n"
+    "  }" "\n"
+    "};" "\n\n"
+    "} //end of filters namespace" "\n"
+    "} //end of http namespace" "\n";
+}
+
+/*
+ * an entry runs its root list in kNone mode against the persistent result
+ * register, exactly as VM::run does.
+ */
+std::string Generator::entry(const Tree & t) {
+  std::string s;
+  if (t.root() != NULL) {
+    s = statements(t.root(), ExecutionMode::kNone, "r_");
+  }
+  return s + "    return r_;" "\n";
+}
+
+std::string Generator::list(const Node * const n,
+    const ExecutionMode::MODES m) {
+  ASSERT(n != NULL);
+  ASSERT(m == ExecutionMode::kAnd || m == ExecutionMode::kOr);
+
+  //prints depend on the intermediate result, they need statements.
+  if (HasPrint(n)) {
+    std::stringstream ss;
+    ss << "list" << counter_++ << "()";
+    const std::string call = ss.str();
+
+    const std::string body = statements(n, m, "r");
+    lists_ << "  inline bool " << call.substr(0, call.size() - 2)
+      << "(void) {" "\n"
+      << "    bool r = " << (m == ExecutionMode::kAnd ? "true" : "false")
+      << ";" "\n"
+      << body
+      << "    return r;" "\n"
+      << "  }" "\n\n";
+    return call;
+  }
+
+  std::string s;
+  uint32_t terms = 0;
+  bool negated = false;
+  for (const Node * i = n; i != NULL; i = i->next) {
+    if (i->type() == NodeTypes::kNot) {
+      negated = true;
+      continue;
+    }
+    if (terms++ > 0) {
+      s += m == ExecutionMode::kAnd ? " && " : " || ";
+    }
+    if (negated) {
+      s += "! ";
+      negated = false;
+    }
+    s += term(i);
+  }
+
+  if (terms == 0) {
+    return m == ExecutionMode::kAnd ? "true" : "false";
+  }
+  return terms > 1 ? "(" + s + ")" : s;
+}
+
+std::string Generator::statements(const Node * const n,
+    const ExecutionMode::MODES m, const char * const r) {
+  ASSERT(n != NULL);
+  std::string gate;
+  switch (m) {
+  case ExecutionMode::kAnd: gate = std::string("if (") + r + ") "; break;
+  case ExecutionMode::kOr: gate = std::string("if ( ! ") + r + ") "; break;
+  default: break;
+  }
+
+  std::string s;
+  bool negated = false;
+  for (const Node * i = n; i != NULL; i = i->next) {
+    switch (i->type()) {
+    case NodeTypes::kNot:
+      negated = true;
+      break;
+
+    case NodeTypes::kOp:
+      {
+        const Op * const o = dynamic_cast< const Op * const >(i);
+        ASSERT(o != NULL);
+        if (o->name == "printError" || o->name == "printDebug") {
+          s += Print(*o, m, r);
+          break;
+        }
+      }
+      //fall through
+
+    default:
+      s += "    " + gate + r + " = " + (negated ? "! " : "") + term(i)
+        + ";" "\n";
+      negated = false;
+      break;
+    }
+  }
+  return s;
+}
+
+std::string Generator::term(const Node * const n) {
+  ASSERT(n != NULL);
+  switch (n->type()) {
+  case NodeTypes::kAnd:
+  case NodeTypes::kOr:
+    {
+      const BinaryNode * const b = dynamic_cast< const BinaryNode * >(n);
+      ASSERT(b != NULL);
+      ASSERT(b->child != NULL);
+      return list(b->child, n->type() == NodeTypes::kAnd
+          ? ExecutionMode::kAnd : ExecutionMode::kOr);
+    }
+
+  case NodeTypes::kOp:
+    {
+      const Op * const o = dynamic_cast< const Op * const >(n);
+      ASSERT(o != NULL);
+      return Call(*o);
+    }
+
+  default:
+    ASSERT(false); //unrecheable
+    return "false";
+  }
+}
+
+bool Generator::HasPrint(const Node * n) {
+  for (; n != NULL; n = n->next) {
+    const Op * const o = dynamic_cast< const Op * const >(n);
+    if (o != NULL && (o->name == "printError" || o->name == "printDebug")) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string Generator::Call(const Op & o) {
+  static const Y y [] = {
+    { "containsCookie", "ContainsCookie", Arguments::kPair },
+    { "containsDomain", "ContainsDomain", Arguments::kLength },
+    { "containsHeader", "ContainsHeader", Arguments::kPair },
+    { "containsHeaderI", "ContainsHeaderI", Arguments::kPairFolded },
+    { "containsPath", "ContainsPath", Arguments::kLength },
+    { "containsQueryParameter", "ContainsQueryParameter", Arguments::kPair },
+    { "equalCookie", "EqualCookie", Arguments::kPair },
+    { "equalDomain", "EqualDomain", Arguments::kLength },
+    { "equalHeader", "EqualHeader", Arguments::kPair },
+    { "equalHeaderI", "EqualHeaderI", Arguments::kPairFolded },
+    { "equalPath", "EqualPath", Arguments::kLength },
+    { "equalQueryParameter", "EqualQueryParameter", Arguments::kPair },
+    { "existsCookie", "ExistsCookie", Arguments::kName },
+    { "existsHeader", "ExistsHeader", Arguments::kName },
+    { "existsQueryParameter", "ExistsQueryParameter", Arguments::kName },
+    { "false", "false", Arguments::kNull },
+    { "greaterThanAfterCookie", "GreaterThanAfterCookie", Arguments::kPairNumber },
+    { "greaterThanAfterHeader", "GreaterThanAfterHeader", Arguments::kPairNumber },
+    { "greaterThanAfterQueryParameter", "GreaterThanAfterQueryParameter", Arguments::kPairNumber },
+    { "greaterThanCookie", "GreaterThanCookie", Arguments::kNumber },
+    { "greaterThanHeader", "GreaterThanHeader", Arguments::kNumber },
+    { "greaterThanQueryParameter", "GreaterThanQueryParameter", Arguments::kNumber },
+    { "isMethod", "IsMethod", Arguments::kLength },
+    { "isScheme", "IsScheme", Arguments::kLength },
+    { "lessThanAfterCookie", "LessThanAfterCookie", Arguments::kPairNumber },
+    { "lessThanAfterHeader", "LessThanAfterHeader", Arguments::kPairNumber },
+    { "lessThanAfterQueryParameter", "LessThanAfterQueryParameter", Arguments::kPairNumber },
+    { "lessThanCookie", "LessThanCookie", Arguments::kNumber },
+    { "lessThanHeader", "LessThanHeader", Arguments::kNumber },
+    { "lessThanQueryParameter", "LessThanQueryParameter", Arguments::kNumber },
+    { "notEqualCookie", "NotEqualCookie", Arguments::kPair },
+    { "notEqualDomain", "NotEqualDomain", Arguments::kLength },
+    { "notEqualHeader", "NotEqualHeader", Arguments::kPair },
+    { "notEqualHeaderI", "NotEqualHeaderI", Arguments::kPairFolded },
+    { "notEqualPath", "NotEqualPath", Arguments::kLength },
+    { "notEqualQueryParameter", "NotEqualQueryParameter", Arguments::kPair },
+    { "startsWithDomain", "StartsWithDomain", Arguments::kLengthOffset },
+    { "startsWithHeader", "StartsWithHeader", Arguments::kPairOffset },
+    { "startsWithPath", "StartsWithPath", Arguments::kLengthOffset },
+    { "startsWithQueryParameter", "StartsWithQueryParameter", Arguments::kPairOffset },
+    { "true", "true", Arguments::kNull },
+  };
+
+  static const Y * const begin = &y[0],
+               * const end = &y[ARRAY_SIZE(y)];
+
+  const Y * const i = std::lower_bound(begin, end, o.name);
+
+  if (i == end || ! (*i == o.name)) {
+    std::cerr << o.name << "\n";
+    ASSERT(false); //unsupported.
+    return "false";
+  }
+
+  const Op::Parameters & p = o.parameters;
+  std::stringstream ss;
+
+  switch (i->c) {
+  case Arguments::kNull:
+    return i->b;
+
+  case Arguments::kLength:
+  case Arguments::kLengthOffset:
+    ASSERT(p.size() == 1);
+    ss << "i_." << i->b << "(" << Literal(p[0]) << ", " << p[0].size()
+      << (i->c == Arguments::kLengthOffset ? ", 0)" : ")");
+    break;
+
+  case Arguments::kName:
+    ASSERT(p.size() == 1);
+    ss << "i_." << i->b << "(" << Literal(p[0]) << ")";
+    break;
+
+  case Arguments::kPair:
+  case Arguments::kPairOffset:
+    ASSERT(p.size() == 2);
+    ss << "i_." << i->b << "(" << Literal(p[0]) << ", " << Literal(p[1])
+      << (i->c == Arguments::kPairOffset ? ", 0)" : ")");
+    break;
+
+  case Arguments::kPairFolded:
+    ASSERT(p.size() == 2);
+    ss << "i_." << i->b << "(" << Literal(p[0]) << ", "
+      << Literal(util::Fold(p[1])) << ")";
+    break;
+
+  //the VM holds numbers in unsigned 32 bits operands.
+  case Arguments::kNumber:
+    ASSERT(p.size() == 2);
+    ss << "i_." << i->b << "(" << Literal(p[0]) << ", "
+      << static_cast< uint32_t >(atoi(p[1].c_str())) << "u)";
+    break;
+
+  case Arguments::kPairNumber:
+    ASSERT(p.size() == 3);
+    ss << "i_." << i->b << "(" << Literal(p[0]) << ", " << Literal(p[1])
+      << ", " << static_cast< uint32_t >(atoi(p[2].c_str())) << "u)";
+    break;
+  }
+
+  return ss.str();
+}
+
+/*
+ * a print runs when its list did not stop yet and its own condition holds.
+ */
+std::string Generator::Print(const Op & o, const ExecutionMode::MODES m,
+    const char * const r) {
+  const Op::Parameters & p = o.parameters;
+  ASSERT( ! p.empty());
+  ASSERT(p.size() <= 3);
+
+  ExecutionMode::MODES c = ExecutionMode::kNone;
+  if (p.size() == 3) {
+    const std::string & s = p[2];
+    if (s == "true" || s == "True" || s == "TRUE") {
+      c = ExecutionMode::kAnd;
+    } else if (s == "false" || s == "False" || s == "FALSE") {
+      c = ExecutionMode::kOr;
+    } else {
+      ASSERT(false); //unsupported
+    }
+  }
+
+  if (c == ExecutionMode::kNone) {
+    c = m;
+  } else if (m != ExecutionMode::kNone && m != c) {
+    //never reached.
+    return "";
+  }
+
+  std::string s = "    ";
+  switch (c) {
+  case ExecutionMode::kAnd: s += std::string("if (") + r + ") "; break;
+  case ExecutionMode::kOr: s += std::string("if ( ! ") + r + ") "; break;
+  default: break;
+  }
+
+  return s + "i_." + (o.name == "printError" ? "PrintError" : "PrintDebug")
+    + "(" + Literal(p[0]) + ", " + Literal(p.size() > 1 ? p[1] : "")
+    + ");" "\n";
+}
+
+std::string Generator::Literal(const std::string & s) {
+  std::string r = "\"";
+  for (size_t i = 0; i < s.size(); ++i) {
+    const unsigned char c = s[i];
+    if (c == '"' || c == '\\') {
+      r += '\\';
+      r += c;
+    } else if (c < 0x20 || c > 0x7e) {
+      char b[5];
+      snprintf(b, sizeof(b), "\\%03o", c);
+      r += b;
+    } else {
+      r += c;
+    }
+  }
+  return r + "\"";
+}
+
+} //end of filters namespace
+} //end of http namespace
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <ostream>
+#include <sstream>
+#include <string>
+
+#include "my-assert.h"
+
+#include "array.h"
+#include "opcodes.h"
+#include "representation.h"
+
+namespace http {
+namespace filters {
+
+/*
+ * Ahead of time backend: translates a Forest into a C++ header declaring
+ *
+ *   template < class I > struct <name> {
+ *     <name>(I &);
+ *     inline bool entry<N>(void);
+ *     inline bool run(const uint32_t);
+ *   };
+ *
+ * with one inlined function per entry calling the implementation predicates
+ * directly. Lists without prints become short-circuit && / || expressions,
+ * the rest are lowered into statements following the VM execution rules, so
+ * results match VM< I >::run for the same entry.
+ */
+struct Generator {
+  std::string name_;
+  std::stringstream lists_;
+  uint32_t counter_;
+
+  Generator(const char * const n = "Rules") : name_(n), counter_(0) { }
+
+  void generate(const Forest &, std::ostream &);
+
+  std::string entry(const Tree &);
+
+  std::string list(const Node * const, const ExecutionMode::MODES);
+
+  std::string statements(const Node * const, const ExecutionMode::MODES,
+      const char * const);
+
+  std::string term(const Node * const);
+
+  static bool HasPrint(const Node *);
+
+  static std::string Call(const Op &);
+
+  static std::string Print(const Op &, const ExecutionMode::MODES,
+      const char * const);
+
+  static std::string Literal(const std::string &);
+};
+
+} //end of filters namespace
+} //end of http namespace
+
+#endif //GENERATOR_H
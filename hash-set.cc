@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#include "hash-set.h"
+
+namespace http {
+namespace filters {
+
+const uint32_t HashSet::kHeader;
+const uint32_t HashSet::kSlot;
+
+void HashSet::Build(const std::vector< std::string > & k,
+    std::vector< uint32_t > & r) {
+  //at most half full, so probes stay short.
+  uint32_t capacity = 1;
+  while (capacity < k.size() * 2) {
+    capacity <<= 1;
+  }
+  const uint32_t mask = capacity - 1;
+
+  r.clear();
+  r.resize(kHeader + capacity * kSlot, 0);
+  r[0] = capacity;
+  r[1] = k.size();
+
+  uint32_t digest = 0;
+  for (uint32_t i = 0; i < k.size(); ++i) {
+    const uint32_t h = Hash(k[i].data(), k[i].size());
+    digest = (digest ^ h) * 16777619u;
+
+    uint32_t j = h & mask;
+    while (r[kHeader + j * kSlot + 1] != 0) {
+      j = (j + 1) & mask;
+    }
+
+    const uint32_t begin = r.size();
+    r.resize(begin + k[i].size() / sizeof(uint32_t) + 1, 0);
+    memcpy(&r[begin], k[i].data(), k[i].size());
+
+    uint32_t * const s = &r[kHeader + j * kSlot];
+    s[0] = h;
+    s[1] = begin * sizeof(uint32_t);
+    s[2] = k[i].size();
+  }
+  r[2] = digest;
+}
+
+} //end of filters namespace
+} //end of http namespace
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#ifndef HASH_SET_H
+#define HASH_SET_H
+
+#include <string>
+#include <vector>
+
+#include <cstring>
+
+#include <stdint.h>
+
+#include "my-assert.h"
+
+namespace http {
+namespace filters {
+
+/*
+ * Open addressing hash set of strings with linear probing, flattened into
+ * 32 bit words so it lives in Memory and is used in place:
+ *
+ *   capacity, size, digest
+ *   capacity times: hash, byte offset of the string, length
+ *   the strings, NUL terminated, padded to a word.
+ *
+ * capacity is a power of two, a slot with offset 0 is empty. digest tells
+ * sets apart without reading their strings.
+ */
+struct HashSet {
+  static const uint32_t kHeader = 3;
+  static const uint32_t kSlot = 3;
+
+  const uint32_t * const t_;
+
+  explicit HashSet(const char * const p) :
+    t_(reinterpret_cast< const uint32_t * >(p)) {
+    ASSERT(p != NULL);
+    ASSERT(reinterpret_cast< uintptr_t >(p) % sizeof(uint32_t) == 0);
+  }
+
+  inline uint32_t capacity(void) const { return t_[0]; }
+  inline uint32_t size(void) const { return t_[1]; }
+  inline uint32_t digest(void) const { return t_[2]; }
+
+  inline const uint32_t * slot(const uint32_t i) const {
+    ASSERT(i < capacity());
+    return t_ + kHeader + i * kSlot;
+  }
+
+  //the string in slot i, NULL if it is empty.
+  inline const char * key(const uint32_t i) const {
+    const uint32_t * const s = slot(i);
+    return s[1] > 0 ? reinterpret_cast< const char * >(t_) + s[1] : NULL;
+  }
+
+  //FNV-1a.
+  static inline uint32_t Hash(const char * const p, const uint32_t l) {
+    uint32_t h = 2166136261u;
+    for (uint32_t i = 0; i < l; ++i) {
+      h = (h ^ static_cast< uint8_t >(p[i])) * 16777619u;
+    }
+    return h;
+  }
+
+  inline bool find(const char * const p, const uint32_t l) const {
+    const uint32_t h = Hash(p, l), mask = capacity() - 1;
+    for (uint32_t i = h & mask; ; i = (i + 1) & mask) {
+      const uint32_t * const s = slot(i);
+      if (s[1] == 0) {
+        return false;
+      }
+      if (s[0] == h && s[2] == l
+          && memcmp(reinterpret_cast< const char * >(t_) + s[1], p, l) == 0) {
+        return true;
+      }
+    }
+  }
+
+  //keys have to be distinct.
+  static void Build(const std::vector< std::string > &,
+      std::vector< uint32_t > &);
+};
+
+} //end of filters namespace
+} //end of http namespace
+
+#endif //HASH_SET_H
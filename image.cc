@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "image.h"
+
+namespace http {
+namespace filters {
+
+const uint32_t Image::kMagic;
+const uint32_t Image::kVersion;
+const uint32_t Image::kAlignment;
+
+static inline void Append(std::string & s, const void * const p,
+    const size_t l) {
+  s.append(static_cast< const char * >(p), l);
+}
+
+static inline void Pad(std::string & s) {
+  s.resize(Image::Align(s.size()), '\0');
+}
+
+//reads l bytes at i, false past e.
+static inline bool Take(const char * & i, const char * const e,
+    void * const p, const size_t l) {
+  if (static_cast< size_t >(e - i) < l) {
+    return false;
+  }
+  memcpy(p, i, l);
+  i += l;
+  return true;
+}
+
+//a NUL terminated string at i, false past e.
+static inline bool Take(const char * & i, const char * const e,
+    std::string & s) {
+  const char * const n = static_cast< const char * >(memchr(i, '\0', e - i));
+  if (n == NULL) {
+    return false;
+  }
+  s.assign(i, n);
+  i = n + 1;
+  return true;
+}
+
+Image::~Image() {
+  if (mapping_ != NULL) {
+    munmap(mapping_, size_);
+  }
+}
+
+bool Image::write(std::ostream & o) const {
+  ASSERT(names.size() == offsets.size());
+  ASSERT(requirements.touches_.size() == offsets.size());
+  std::string b;
+  Append(b, code.t, code.size * sizeof(Code::Type));
+  Pad(b);
+  Append(b, memory.t, memory.size);
+  Pad(b);
+  if ( ! offsets.empty()) {
+    Append(b, &offsets[0], offsets.size() * sizeof(uint32_t));
+  }
+  Pad(b);
+
+  PerfectHash::Entries e;
+  for (uint32_t i = 0; i < names.size(); ++i) {
+    e.push_back(std::make_pair(names[i], i));
+  }
+  std::vector< uint32_t > t;
+  PerfectHash::Build(e, t);
+  Append(b, &t[0], t.size() * sizeof(uint32_t));
+
+  const size_t n = b.size();
+  for (Names::const_iterator it = names.begin(); it != names.end(); ++it) {
+    b.append(it->c_str(), it->size() + 1);
+  }
+  const size_t r = b.size();
+
+  const Requirements & q = requirements;
+  const uint32_t count = q.names_.size();
+  Append(b, &count, sizeof(count));
+  for (Requirements::Names::const_iterator it = q.names_.begin();
+      it != q.names_.end(); ++it) {
+    Append(b, &it->first, sizeof(it->first));
+    b.append(it->second.c_str(), it->second.size() + 1);
+  }
+  for (uint32_t i = 0; i < q.touches_.size(); ++i) {
+    Append(b, &q.touches_[i], sizeof(Requirements::Mask));
+    Append(b, &q.needs_[i], sizeof(Requirements::Mask));
+  }
+
+  Header h;
+  h.magic = kMagic;
+  h.version = kVersion;
+  h.checksum = Checksum(b.data(), b.size());
+  h.code = code.size;
+  h.memory = memory.size;
+  h.entries = offsets.size();
+  h.table = t.size();
+  h.names = r - n;
+  h.requirements = b.size() - r;
+  h.diagram = diagram;
+  h.entry = entry;
+
+  std::string header;
+  Append(header, &h, sizeof(h));
+  Pad(header);
+  o << header << b;
+  return o.good();
+}
+
+bool Image::load(const char * const p) {
+  ASSERT(p != NULL);
+  ASSERT(mapping_ == NULL);
+  const int f = open(p, O_RDONLY);
+  if (f < 0) {
+    return false;
+  }
+  struct stat s;
+  if (fstat(f, &s) != 0 || static_cast< size_t >(s.st_size) < sizeof(Header)) {
+    close(f);
+    return false;
+  }
+  const size_t size = s.st_size;
+  void * const m = mmap(NULL, size, PROT_READ, MAP_SHARED, f, 0);
+  close(f);
+  if (m == MAP_FAILED) {
+    return false;
+  }
+
+  const char * const begin = static_cast< const char * >(m),
+        * const end = begin + size;
+  Header h;
+  memcpy(&h, begin, sizeof(h));
+  //where each section starts.
+  const size_t atCode = Align(sizeof(Header)),
+        atMemory = atCode + Align(static_cast< size_t >(h.code)
+            * sizeof(Code::Type)),
+        atEntries = atMemory + Align(h.memory),
+        atTable = atEntries + Align(static_cast< size_t >(h.entries)
+            * sizeof(uint32_t)),
+        atNames = atTable
+          + static_cast< size_t >(h.table) * sizeof(uint32_t),
+        atRequirements = atNames + h.names;
+  if (h.magic != kMagic || h.version != kVersion || h.code == 0
+      || h.code % kSize != 0 || h.memory == 0
+      || atRequirements + h.requirements != size
+      || h.checksum != Checksum(begin + atCode, size - atCode)) {
+    munmap(m, size);
+    return false;
+  }
+
+  Offsets o(h.entries);
+  if ( ! o.empty()) {
+    memcpy(&o[0], begin + atEntries, o.size() * sizeof(uint32_t));
+  }
+  //every slot of the table within it.
+  const uint32_t * const t =
+    reinterpret_cast< const uint32_t * >(begin + atTable);
+  bool valid = h.table >= PerfectHash::kHeader + 1 && t[0] == h.entries
+    && t[1] > 0 && PerfectHash::kHeader + static_cast< size_t >(t[1])
+      + static_cast< size_t >(t[0]) * PerfectHash::kSlot <= h.table;
+  for (uint32_t k = 0; valid && k < t[0]; ++k) {
+    const uint32_t * const s = PerfectHash(t).slot(k);
+    valid = static_cast< size_t >(s[0]) + s[1]
+      <= static_cast< size_t >(h.table) * sizeof(uint32_t)
+      && s[2] < h.entries;
+  }
+  Names n(h.entries);
+  const char * i = begin + atNames;
+  for (uint32_t k = 0; valid && k < n.size(); ++k) {
+    valid = Take(i, begin + atRequirements, n[k]);
+  }
+  valid = valid && i == begin + atRequirements;
+
+  Requirements r;
+  uint32_t count = 0;
+  i = begin + atRequirements;
+  valid = valid && Take(i, end, &count, sizeof(count))
+    && Requirements::kFixed + count <= Requirements::kBits;
+  for (uint32_t k = 0; valid && k < count; ++k) {
+    Requirements::Name name;
+    valid = Take(i, end, &name.first, sizeof(name.first))
+      && Take(i, end, name.second);
+    r.names_.push_back(name);
+    r.bits_.insert(std::make_pair(name, Requirements::kFixed + k));
+  }
+  r.touches_.resize(h.entries);
+  r.needs_.resize(h.entries);
+  for (uint32_t k = 0; valid && k < h.entries; ++k) {
+    valid = Take(i, end, &r.touches_[k], sizeof(Requirements::Mask))
+      && Take(i, end, &r.needs_[k], sizeof(Requirements::Mask));
+    r.all_ |= r.touches_[k];
+  }
+  for (uint32_t k = 0; valid && k < o.size(); ++k) {
+    valid = o[k] < h.code / kSize;
+  }
+  if ( ! valid || i != end || (h.diagram && h.entry >= h.code / kSize)) {
+    munmap(m, size);
+    return false;
+  }
+
+  code = Code(reinterpret_cast< const uint32_t * >(begin + atCode), h.code);
+  memory = Memory(begin + atMemory, h.memory);
+  offsets.swap(o);
+  table = t;
+  names.swap(n);
+  requirements = r;
+  diagram = h.diagram != 0;
+  entry = h.entry;
+  mapping_ = m;
+  size_ = size;
+  return true;
+}
+
+//FNV-1a over 8 byte words, so checking a large image stays cheap.
+uint32_t Image::Checksum(const char * const p, const size_t l) {
+  uint64_t h = 14695981039346656037ull;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= l; i += sizeof(uint64_t)) {
+    uint64_t w;
+    memcpy(&w, p + i, sizeof(w));
+    h = (h ^ w) * 1099511628211ull;
+  }
+  for (; i < l; ++i) {
+    h = (h ^ static_cast< uint8_t >(p[i])) * 1099511628211ull;
+  }
+  return static_cast< uint32_t >(h ^ (h >> 32));
+}
+
+} //end of filters namespace
+} //end of http namespace
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "my-assert.h"
+
+#include "perfect-hash.h"
+#include "program.h"
+#include "requirements.h"
+#include "vm.h"
+
+namespace http {
+namespace filters {
+
+/*
+ * A compiled forest on disk. load maps the file read-only and code and
+ * memory point straight into the mapping, so every process loading the
+ * same file shares its pages. The layout, in host byte order, each
+ * section starting at a multiple of kAlignment:
+ *
+ *   Header
+ *   code, header.code words
+ *   memory, header.memory bytes
+ *   offsets, header.entries words
+ *   table, header.table words: entry indices by name, see PerfectHash
+ *   names, header.names bytes: every entry name, NUL terminated
+ *   requirements, header.requirements bytes: the count of names, every
+ *     name as its component word and its NUL terminated string, then the
+ *     touches and needs masks of every entry.
+ *
+ * checksum covers everything after the Header. Files of another version
+ * or byte order are refused rather than converted.
+ */
+struct Image {
+  typedef std::vector< std::string > Names;
+
+  //"TLFH" on a little endian host.
+  static const uint32_t kMagic = 0x48464C54;
+  static const uint32_t kVersion = 2;
+  static const uint32_t kAlignment = 8;
+
+  struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t checksum;
+    uint32_t code;
+    uint32_t memory;
+    uint32_t entries;
+    uint32_t table;
+    uint32_t names;
+    uint32_t requirements;
+    uint32_t diagram;
+    uint32_t entry;
+  };
+
+  Code code;
+  Memory memory;
+  Offsets offsets;
+  //in the mapping, NULL until loaded.
+  const uint32_t * table;
+  Names names;
+  Requirements requirements;
+  bool diagram;
+  uint32_t entry;
+
+  //what load mapped, NULL when code and memory belong to someone else.
+  //An Image owning a mapping is never copied.
+  void * mapping_;
+  size_t size_;
+
+  Image(void) : table(NULL), diagram(false), entry(0), mapping_(NULL),
+    size_(0) { }
+
+  ~Image();
+
+  bool write(std::ostream &) const;
+
+  //false, with nothing mapped, on anything but a well formed file.
+  bool load(const char * const);
+
+  //the index of the entry named by the l bytes at p, once loaded.
+  inline bool find(const char * const p, const uint32_t l,
+      uint32_t & e) const {
+    ASSERT(table != NULL);
+    return PerfectHash(table).find(p, l, e);
+  }
+
+  static uint32_t Checksum(const char * const, const size_t);
+
+  static inline size_t Align(const size_t s) {
+    return (s + kAlignment - 1) / kAlignment * kAlignment;
+  }
+};
+
+} //end of filters namespace
+} //end of http namespace
+
+#endif //IMAGE_H
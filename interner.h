@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include <vector>
+
+#include <cstring>
+
+#include <stdint.h>
+
+#include "my-assert.h"
+
+namespace http {
+namespace filters {
+
+/*
+ * Open addressing hash table with linear probing over the NUL terminated
+ * strings of a memory, by their offset in it. Keys are never copied: a
+ * lookup hashes once and compares in place. Offset 0 marks an empty slot
+ * and the table doubles before it is half full.
+ */
+struct Interner {
+  struct Slot {
+    uint32_t hash;
+    uint32_t offset;
+    Slot(void) : hash(0), offset(0) { }
+  };
+
+  typedef std::vector< Slot > Slots;
+  typedef std::vector< char > Memory;
+
+  static const uint32_t kMinimum = 64;
+
+  Slots slots_;
+  uint32_t size_;
+
+  Interner(void) : size_(0) { }
+
+  inline uint32_t size(void) const { return size_; }
+
+  inline void clear(void) {
+    slots_.clear();
+    size_ = 0;
+  }
+
+  //where the string l bytes long at p with hash h is in m, 0 if nowhere.
+  inline uint32_t find(const Memory & m, const char * const p,
+      const uint32_t l, const uint32_t h) const {
+    if (slots_.empty()) {
+      return 0;
+    }
+    const uint32_t mask = slots_.size() - 1;
+    for (uint32_t i = h & mask; ; i = (i + 1) & mask) {
+      const Slot & s = slots_[i];
+      if (s.offset == 0) {
+        return 0;
+      }
+      if (s.hash == h && s.offset + l < m.size() && m[s.offset + l] == '\0'
+          && memcmp(&m[s.offset], p, l) == 0) {
+        return s.offset;
+      }
+    }
+  }
+
+  //o is not there yet.
+  inline void insert(const uint32_t h, const uint32_t o) {
+    ASSERT(o > 0);
+    if (2 * (size_ + 1) > slots_.size()) {
+      grow();
+    }
+    place(h, o);
+    ++size_;
+  }
+
+  inline void place(const uint32_t h, const uint32_t o) {
+    const uint32_t mask = slots_.size() - 1;
+    uint32_t i = h & mask;
+    while (slots_[i].offset != 0) {
+      i = (i + 1) & mask;
+    }
+    slots_[i].hash = h;
+    slots_[i].offset = o;
+  }
+
+  inline void grow(void) {
+    Slots s(slots_.empty() ? kMinimum : slots_.size() * 2);
+    s.swap(slots_);
+    const Slots::const_iterator END = s.end();
+    for (Slots::const_iterator it = s.begin(); it != END; ++it) {
+      if (it->offset != 0) {
+        place(it->hash, it->offset);
+      }
+    }
+  }
+};
+
+} //end of filters namespace
+} //end of http namespace
+
+#endif //INTERNER_H
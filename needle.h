@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#ifndef NEEDLE_H
+#define NEEDLE_H
+
+#include <algorithm>
+
+#include <cstring>
+
+#include <stdint.h>
+
+#include "my-assert.h"
+
+#include "fold.h"
+
+namespace http {
+namespace filters {
+
+/*
+ * A string searched for, with its Boyer-Moore-Horspool table when it has
+ * one. Assembler::pushNeedle lays it out in Memory as:
+ *
+ *   kTable bytes, the table, only when at least kShortest long
+ *   the string, NUL terminated.
+ *
+ * the table holds, per byte, how far the needle moves when that byte is
+ * under its last one, at most 255. Needles built from a plain string, or
+ * shorter than kShortest, are searched naively.
+ *
+ * findFolded ignores the case of what it searches, for needles folded when
+ * pushed: their table, looked up by folded bytes, is the one find uses.
+ */
+struct Needle {
+  static const uint32_t kTable = 256;
+  static const uint32_t kShortest = 4;
+
+  const char * pointer;
+  uint32_t length;
+  const uint8_t * table;
+
+  Needle(const char * const p) :
+    pointer(p), length(p != NULL ? strlen(p) : 0), table(NULL) { }
+
+  Needle(const char * const p, const uint32_t l, const uint8_t * const t) :
+    pointer(p), length(l), table(t) {
+    ASSERT(p != NULL);
+  }
+
+  //the needle at p in Memory, l long.
+  static inline Needle In(const char * const p, const uint32_t l) {
+    return Needle(p, l, l >= kShortest
+        ? reinterpret_cast< const uint8_t * >(p) - kTable : NULL);
+  }
+
+  inline operator const char * (void) const { return pointer; }
+
+  //the same needle cut to its first l bytes.
+  inline Needle prefix(const uint32_t l) const {
+    ASSERT(l <= length);
+    return l == length ? *this : Needle(pointer, l, NULL);
+  }
+
+  //where it first starts in [begin, end), end if nowhere.
+  inline const char * find(const char * const begin,
+      const char * const end) const {
+    ASSERT(begin <= end);
+    if (table == NULL) {
+      return std::search(begin, end, pointer, pointer + length);
+    }
+    ASSERT(length >= kShortest);
+    if (static_cast< uint32_t >(end - begin) < length) {
+      return end;
+    }
+    const uint32_t last = length - 1;
+    const char l = pointer[last];
+    for (const char * i = begin; i <= end - length;
+        i += table[static_cast< uint8_t >(i[last])]) {
+      if (i[last] == l && memcmp(i, pointer, last) == 0) {
+        return i;
+      }
+    }
+    return end;
+  }
+
+  inline const char * findFolded(const char * const begin,
+      const char * const end) const {
+    ASSERT(begin <= end);
+    if (static_cast< uint32_t >(end - begin) < length) {
+      return end;
+    }
+    if (length == 0) {
+      return begin;
+    }
+    const uint32_t last = length - 1;
+    const char l = pointer[last];
+    for (const char * i = begin; i <= end - length;
+        i += table != NULL
+          ? table[static_cast< uint8_t >(util::Fold(i[last]))] : 1) {
+      if (util::Fold(i[last]) == l && util::EqualFolded(i, pointer, last)) {
+        return i;
+      }
+    }
+    return end;
+  }
+
+  static inline void Build(const char * const p, const uint32_t l,
+      uint8_t * const t) {
+    ASSERT(l >= kShortest);
+    std::fill(t, t + kTable, static_cast< uint8_t >(std::min(l, 255u)));
+    for (uint32_t i = 0; i + 1 < l; ++i) {
+      t[static_cast< uint8_t >(p[i])] =
+        static_cast< uint8_t >(std::min(l - 1 - i, 255u));
+    }
+  }
+};
+
+} //end of filters namespace
+} //end of http namespace
+
+#endif //NEEDLE_H
@@ -187,6 +187,91 @@ struct Opcodes {
     kLessThanAfterCookie,
     kNotEqualCookie,
 
+    /*
+     * Fused exists + comparison: one lookup and one dispatch for an
+     * existsX(name) immediately followed by a comparison on the same name.
+     * Relies on the comparison implying existence, so the pair evaluates to:
+     *  - kNone, kAnd: the comparison's result.
+     *  - kOr: the existence's result.
+     * 1st parameter: name.
+     * 2nd parameter: Comparison value.
+     * 3rd parameter: Mode of the list the pair belongs to.
+     */
+    kExistsContainsQueryParameter,
+    kExistsEqualQueryParameter,
+    kExistsGreaterThanQueryParameter,
+    kExistsLessThanQueryParameter,
+    kExistsStartsWithQueryParameter,
+
+    kExistsContainsHeader,
+    kExistsEqualHeader,
+    kExistsGreaterThanHeader,
+    kExistsLessThanHeader,
+    kExistsStartsWithHeader,
+
+    kExistsContainsCookie,
+    kExistsEqualCookie,
+    kExistsGreaterThanCookie,
+    kExistsLessThanCookie,
+
+    /*
+     * Jumps to address, without touching the registers stack.
+     * 1st parameter: Code's memory offset.
+     */
+    kJump,
+
+    /*
+     * Jumps to address when Result register value is true, otherwise
+     * continues with the next instruction.
+     * 1st parameter: Code's memory offset.
+     */
+    kJumpIfTrue,
+
+    /*
+     * Jumps to address when Result register value is false, otherwise
+     * continues with the next instruction.
+     * 1st parameter: Code's memory offset.
+     */
+    kJumpIfFalse,
+
+    /*
+     * contains against all the needles collected for the same target at
+     * once, see Automaton. The first one evaluated scans the value a single
+     * time and answers every predicate sharing the automaton.
+     * 1st parameter: name, none for domain and path.
+     * 2nd parameter: Automaton's memory offset.
+     * 3rd parameter: needle's index in the automaton.
+     */
+    kContainsManyDomain,
+    kContainsManyPath,
+    kContainsManyQueryParameter,
+    kContainsManyHeader,
+    kContainsManyCookie,
+
+    /*
+     * whether the domain or the path equals any string of the set, what
+     * an Or of equalDomain or equalPath compiles into, see HashSet.
+     * 1st parameter: HashSet's memory offset.
+     */
+    kEqualDomainSet,
+    kEqualPathSet,
+
+    /*
+     * terminal of a decision diagram: the entries true for the path taken
+     * to it, see VM::runDiagram. Result is whether there is any.
+     * 1st parameter: memory offset of the count, then the entries.
+     */
+    kMatches,
+
+    /*
+     * Headers, ignoring the case of the value.
+     * 1st parameter: Header name.
+     * 2nd parameter: Comparison value, folded to lower case.
+     */
+    kContainsHeaderI,
+    kEqualHeaderI,
+    kNotEqualHeaderI,
+
     /*
      * invalid instruction.
      * no arguments.
@@ -0,0 +1,401 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#include "my-assert.h"
+
+#include "optimizer.h"
+#include "program.h"
+
+namespace http {
+namespace filters {
+
+static inline bool IsJump(const uint32_t op) {
+  return op == Opcodes::kJump
+    || op == Opcodes::kJumpIfTrue
+    || op == Opcodes::kJumpIfFalse;
+}
+
+static inline bool IsConstant(const uint32_t op) {
+  return op == Opcodes::kTrue || op == Opcodes::kFalse;
+}
+
+uint32_t Optimizer::optimize(Offsets & e) {
+  //kExecute counts instructions, it has to be left as it is.
+  for (uint32_t i = 0; i < size(); ++i) {
+    if ((*this)[i].op == Opcodes::kExecute && (*this)[i].c != 0) {
+      return 0;
+    }
+  }
+
+  removed_.assign(size(), false);
+  for (uint32_t i = 0; i < size(); ++i) {
+    removed_[i] = (*this)[i].op == Opcodes::kSkip;
+  }
+
+  bool changed = true;
+  while (changed) {
+    mark(e);
+    changed = constants();
+    changed = blocks() || changed;
+    changed = executes() || changed;
+    changed = jumps() || changed;
+    changed = reachable(e) || changed;
+  }
+
+  uint32_t r = 0;
+  for (uint32_t i = 0; i < size(); ++i) {
+    r += removed_[i];
+  }
+  compact(e);
+  return r;
+}
+
+uint32_t Optimizer::collect(Offsets & e) {
+  removed_.assign(size(), false);
+  reachable(e);
+
+  uint32_t r = 0;
+  for (uint32_t i = 0; i < size(); ++i) {
+    r += removed_[i];
+  }
+  compact(e);
+  return r;
+}
+
+void Optimizer::mark(const Offsets & e) {
+  targets_.assign(size() + 1, false);
+  targets_[0] = true;
+  for (uint32_t i = 0; i < e.size(); ++i) {
+    targets_[effective(e[i])] = true;
+  }
+  const Labels::const_iterator END = assembler_.labels_.end();
+  for (Labels::const_iterator it = assembler_.labels_.begin(); it != END;
+      ++it) {
+    targets_[effective(it->second)] = true;
+  }
+
+  modes_.clear();
+  singles_.assign(size(), false);
+  for (uint32_t i = 0; i < size(); ++i) {
+    if (removed_[i]) {
+      continue;
+    }
+    const Instruction & k = (*this)[i];
+    const Operands o = Operands::Of(k.op);
+    if (o.a == Operands::kAddress) {
+      targets_[effective(k.a)] = true;
+    }
+    if (k.op == Opcodes::kExecuteSingle) {
+      singles_[k.a] = true;
+    }
+    if (o.b == Operands::kAddress) {
+      targets_[effective(k.b)] = true;
+    }
+    if (k.op == Opcodes::kExecute) {
+      const std::pair< Modes::iterator, bool > r =
+        modes_.insert(std::make_pair(effective(k.b), k.a));
+      if (r.first->second != k.a) {
+        r.first->second = ExecutionMode::kNull;
+      }
+    }
+  }
+
+  blocks_.assign(size(), false);
+  const Modes::const_iterator MEND = modes_.end();
+  for (Modes::const_iterator it = modes_.begin(); it != MEND; ++it) {
+    for (uint32_t i = it->first;
+        i < size() && (*this)[i].op != Opcodes::kReturn; i = next(i)) {
+      blocks_[i] = true;
+      if (IsJump((*this)[i].op) || (*this)[i].op == Opcodes::kHalt) {
+        break;
+      }
+    }
+  }
+}
+
+/*
+ * kNot over a constant, however many kNot, is the other constant. Where
+ * the mode is kNone every item sets the result, so a constant right
+ * before a predicate is never read.
+ */
+bool Optimizer::constants(void) {
+  bool changed = false;
+  for (uint32_t i = effective(0); i < size(); i = next(i)) {
+    if ( ! IsConstant((*this)[i].op)) {
+      continue;
+    }
+
+    const uint32_t p = previous(i), n = next(i);
+    if ( ! blocks_[i] && ! singles_[i] && n < size() && ! blocks_[n]
+        && Program::Memoized((*this)[n].op) && (*this)[n].op != Opcodes::kFlip
+        && (p >= size() || (*this)[p].op != Opcodes::kNot)) {
+      removed_[i] = true;
+      changed = true;
+      continue;
+    }
+
+    if (targets_[i]) {
+      continue;
+    }
+    bool negated = false;
+    for (uint32_t k = previous(i);
+        k < size() && (*this)[k].op == Opcodes::kNot; k = previous(k)) {
+      removed_[k] = true;
+      negated = true;
+    }
+    if (negated) {
+      Instruction & k = (*this)[i];
+      k.op = k.op == Opcodes::kTrue ? Opcodes::kFalse : Opcodes::kTrue;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+/*
+ * An And block only runs an item while the result is true, an Or block
+ * while it is false, so a constant either does nothing or ends the block.
+ */
+bool Optimizer::blocks(void) {
+  bool changed = false;
+  const Modes::const_iterator END = modes_.end();
+  for (Modes::const_iterator it = modes_.begin(); it != END; ++it) {
+    const uint32_t m = it->second;
+    if (m != ExecutionMode::kAnd && m != ExecutionMode::kOr) {
+      continue;
+    }
+
+    std::vector< uint32_t > items;
+    uint32_t i = it->first;
+    for (; i < size() && (*this)[i].op != Opcodes::kReturn; i = next(i)) {
+      if (IsJump((*this)[i].op) || (*this)[i].op == Opcodes::kHalt) {
+        break;
+      }
+      items.push_back(i);
+    }
+    if (i >= size() || (*this)[i].op != Opcodes::kReturn) {
+      continue;
+    }
+
+    for (uint32_t j = 0; j < items.size(); ++j) {
+      const Instruction & k = (*this)[items[j]];
+      if ( ! IsConstant(k.op)
+          || (j > 0 && (targets_[items[j]]
+              || (*this)[items[j - 1]].op == Opcodes::kNot))) {
+        continue;
+      }
+
+      if ((m == ExecutionMode::kAnd) == (k.op == Opcodes::kTrue)) {
+        removed_[items[j]] = true;
+        changed = true;
+        continue;
+      }
+
+      bool entered = false;
+      for (uint32_t l = j + 1; l < items.size(); ++l) {
+        entered = entered || targets_[items[l]];
+      }
+      if ( ! entered) {
+        for (uint32_t l = j + 1; l < items.size(); ++l) {
+          removed_[items[l]] = true;
+          changed = true;
+        }
+      }
+      break;
+    }
+  }
+  return changed;
+}
+
+/*
+ * A kExecute leaves the result of its block with its own Not applied, so
+ * does the single predicate or constant it would run. One a kExecuteSingle
+ * refers to stays a kExecute.
+ */
+bool Optimizer::executes(void) {
+  bool changed = false;
+  for (uint32_t i = effective(0); i < size(); i = next(i)) {
+    Instruction & k = (*this)[i];
+    if (k.op != Opcodes::kExecute || singles_[i]) {
+      continue;
+    }
+    const uint32_t s = effective(k.b);
+    if (s >= size()) {
+      continue;
+    }
+
+    const Instruction & b = (*this)[s];
+    if (b.op == Opcodes::kReturn) {
+      k = Instruction(k.a == ExecutionMode::kOr
+          ? Opcodes::kFalse : Opcodes::kTrue, 0, 0, 0);
+      changed = true;
+    } else if (Program::Memoized(b.op) && b.op != Opcodes::kFlip
+        && next(s) < size() && (*this)[next(s)].op == Opcodes::kReturn) {
+      k = b;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+bool Optimizer::jumps(void) {
+  bool changed = false;
+  for (uint32_t i = effective(0); i < size(); i = next(i)) {
+    Instruction & k = (*this)[i];
+    if ( ! IsJump(k.op)) {
+      continue;
+    }
+
+    //the register is the same at the target, so is its decision.
+    uint32_t t = effective(k.a);
+    for (uint32_t j = 0; t < size() && j < size()
+        && ((*this)[t].op == Opcodes::kJump || (*this)[t].op == k.op); ++j) {
+      const uint32_t u = effective((*this)[t].a);
+      if (u == t) {
+        break;
+      }
+      t = u;
+    }
+
+    if (t != k.a) {
+      k.a = t;
+      changed = true;
+    }
+    if (t == next(i)) {
+      removed_[i] = true;
+      changed = true;
+      continue;
+    }
+
+    //the result is known when it was just set to a constant.
+    const uint32_t p = previous(i);
+    if (k.op == Opcodes::kJump || targets_[i] || p >= size()
+        || ! IsConstant((*this)[p].op) || blocks_[i]
+        || (previous(p) < size() && (*this)[previous(p)].op == Opcodes::kNot)) {
+      continue;
+    }
+    if ((k.op == Opcodes::kJumpIfTrue) == ((*this)[p].op == Opcodes::kTrue)) {
+      k.op = Opcodes::kJump;
+    } else {
+      removed_[i] = true;
+    }
+    changed = true;
+  }
+  return changed;
+}
+
+bool Optimizer::reachable(const Offsets & e) {
+  Marks keep(size(), false), walked(size(), false);
+  std::vector< uint32_t > work;
+  //the kSkip at 0 stays, what follows it belongs to the first entry.
+  keep[0] = true;
+  for (uint32_t i = 0; i < e.size(); ++i) {
+    work.push_back(effective(e[i]));
+  }
+  const Labels::const_iterator END = assembler_.labels_.end();
+  for (Labels::const_iterator it = assembler_.labels_.begin(); it != END;
+      ++it) {
+    work.push_back(effective(it->second));
+  }
+
+  while ( ! work.empty()) {
+    uint32_t i = work.back();
+    work.pop_back();
+    for (bool go = true; go && i < size() && ! walked[i]; i = next(i)) {
+      walked[i] = keep[i] = true;
+      const Instruction & k = (*this)[i];
+      switch (k.op) {
+      case Opcodes::kReturn:
+      case Opcodes::kHalt:
+        go = false;
+        break;
+
+      case Opcodes::kJump:
+        work.push_back(effective(k.a));
+        go = false;
+        break;
+
+      case Opcodes::kJumpIfTrue:
+      case Opcodes::kJumpIfFalse:
+        work.push_back(effective(k.a));
+        break;
+
+      case Opcodes::kExecute:
+        work.push_back(effective(k.b));
+        break;
+
+      case Opcodes::kExecuteSingle:
+        //decoded into a copy of what it refers to, so that stays.
+        for (uint32_t a = k.a; ; a = (*this)[a].a) {
+          ASSERT( ! removed_[a]);
+          keep[a] = true;
+          if ((*this)[a].op == Opcodes::kExecute) {
+            work.push_back(effective((*this)[a].b));
+          }
+          if ((*this)[a].op != Opcodes::kExecuteSingle) {
+            break;
+          }
+        }
+        break;
+
+      default:
+        break;
+      }
+    }
+  }
+
+  bool changed = false;
+  for (uint32_t i = 0; i < size(); ++i) {
+    if ( ! removed_[i] && ! keep[i]) {
+      removed_[i] = changed = true;
+    }
+  }
+  return changed;
+}
+
+void Optimizer::compact(Offsets & e) {
+  std::vector< uint32_t > addresses(size() + 1);
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < size(); ++i) {
+    kept += ! removed_[i];
+  }
+  addresses[size()] = kept;
+  for (uint32_t i = size(); i > 0; --i) {
+    addresses[i - 1] = removed_[i - 1] ? addresses[i] : --kept;
+  }
+
+  Assembler::Instructions r;
+  r.reserve(addresses[size()]);
+  for (uint32_t i = 0; i < size(); ++i) {
+    if (removed_[i]) {
+      continue;
+    }
+    Instruction k = (*this)[i];
+    const Operands o = Operands::Of(k.op);
+    if (o.a == Operands::kAddress) {
+      k.a = addresses[k.a];
+    }
+    if (o.b == Operands::kAddress) {
+      k.b = addresses[k.b];
+    }
+    r.push_back(k);
+  }
+  assembler_.instructions_.swap(r);
+
+  for (uint32_t i = 0; i < e.size(); ++i) {
+    e[i] = addresses[e[i]];
+  }
+  const Labels::iterator END = assembler_.labels_.end();
+  for (Labels::iterator it = assembler_.labels_.begin(); it != END; ++it) {
+    it->second = addresses[it->second];
+  }
+  removed_.clear();
+  targets_.clear();
+  singles_.clear();
+}
+
+} //end of filters namespace
+} //end of http namespace
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <map>
+#include <vector>
+
+#include <stdint.h>
+
+#include "assembler.h"
+#include "vm.h"
+
+namespace http {
+namespace filters {
+
+/*
+ * Peephole pass over the code of an Assembler, once it is complete:
+ *
+ *   kNot over kTrue / kFalse becomes the other constant.
+ *   kTrue inside an And block, kFalse inside an Or block, do nothing and
+ *   go, the opposite short-circuits it and what follows is dropped.
+ *   outside blocks a constant the next predicate overwrites goes, and a
+ *   conditional jump right after a constant becomes a kJump or goes.
+ *   kExecute of an empty block becomes its constant, of a block with a
+ *   single item becomes that item.
+ *   jumps to jumps are threaded, jumps to the next instruction go.
+ *   kSkip goes, and whatever is not reachable from address 0, the entries
+ *   or the labels, like the kHalt after every entry.
+ *
+ * Instructions are first marked removed, a removed address means the next
+ * instruction kept, then the code is compacted and every address in it,
+ * in the entries and in the labels is rewritten.
+ */
+struct Optimizer {
+  typedef std::vector< bool > Marks;
+  typedef std::map< uint32_t, uint32_t > Modes;
+
+  Assembler & assembler_;
+  Marks removed_;
+  //addresses something jumps, executes or enters into.
+  Marks targets_;
+  //the mode of each kExecute block, by address, kNull when they differ.
+  Modes modes_;
+  //instructions inside those blocks, where the mode is not kNone.
+  Marks blocks_;
+  //the kExecute a kExecuteSingle refers to, by its address, left alone.
+  Marks singles_;
+
+  Optimizer(Assembler & a) : assembler_(a) { }
+
+  //the number of instructions removed.
+  uint32_t optimize(Offsets &);
+
+  //only removes what is no longer reachable, the same way.
+  uint32_t collect(Offsets &);
+
+  void mark(const Offsets &);
+
+  bool constants(void);
+
+  bool blocks(void);
+
+  bool executes(void);
+
+  bool jumps(void);
+
+  bool reachable(const Offsets &);
+
+  void compact(Offsets &);
+
+  inline uint32_t size(void) const {
+    return assembler_.instructions_.size();
+  }
+
+  inline Instruction & operator [] (const uint32_t i) {
+    ASSERT(i < size());
+    return assembler_.instructions_[i];
+  }
+
+  //the first instruction kept from i on.
+  inline uint32_t effective(uint32_t i) const {
+    while (i < size() && removed_[i]) {
+      ++i;
+    }
+    return i;
+  }
+
+  inline uint32_t next(const uint32_t i) const { return effective(i + 1); }
+
+  //the last instruction kept before i, size() if there is none.
+  inline uint32_t previous(uint32_t i) const {
+    while (i > 0) {
+      if ( ! removed_[--i]) {
+        return i;
+      }
+    }
+    return size();
+  }
+};
+
+} //end of filters namespace
+} //end of http namespace
+
+#endif //OPTIMIZER_H
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#include <algorithm>
+#include <functional>
+
+#include "perfect-hash.h"
+
+namespace http {
+namespace filters {
+
+const uint32_t PerfectHash::kHeader;
+const uint32_t PerfectHash::kSlot;
+
+typedef std::vector< uint32_t > Indices;
+
+void PerfectHash::Build(const Entries & e, std::vector< uint32_t > & r) {
+  const uint32_t size = e.size(), buckets = std::max(1u, size / 2);
+
+  std::vector< Indices > b(buckets);
+  for (uint32_t i = 0; i < size; ++i) {
+    const std::string & n = e[i].first;
+    b[Hash(n.data(), n.size(), 0) % buckets].push_back(i);
+  }
+  //larger buckets first, while most slots are free.
+  std::vector< std::pair< uint32_t, uint32_t > > sizes(buckets);
+  for (uint32_t i = 0; i < buckets; ++i) {
+    sizes[i] = std::make_pair(b[i].size(), i);
+  }
+  std::stable_sort(sizes.begin(), sizes.end(),
+      std::greater< std::pair< uint32_t, uint32_t > >());
+
+  r.clear();
+  r.resize(kHeader + buckets + size * kSlot, 0);
+  r[0] = size;
+  r[1] = buckets;
+
+  //per slot, the entry it holds plus one.
+  std::vector< uint32_t > taken(size, 0);
+  std::vector< uint32_t > slots;
+  for (uint32_t k = 0; k < buckets && sizes[k].first > 0; ++k) {
+    const Indices & bucket = b[sizes[k].second];
+    for (uint32_t i = 1; i < bucket.size(); ++i) {
+      for (uint32_t j = 0; j < i; ++j) {
+        ASSERT(e[bucket[i]].first != e[bucket[j]].first);
+      }
+    }
+    for (uint32_t seed = 1; ; ++seed) {
+      ASSERT(seed != 0);
+      slots.clear();
+      bool free = true;
+      for (uint32_t i = 0; free && i < bucket.size(); ++i) {
+        const std::string & n = e[bucket[i]].first;
+        const uint32_t s = Hash(n.data(), n.size(), seed) % size;
+        free = taken[s] == 0
+          && std::find(slots.begin(), slots.end(), s) == slots.end();
+        slots.push_back(s);
+      }
+      if ( ! free) {
+        continue;
+      }
+      r[kHeader + sizes[k].second] = seed;
+      for (uint32_t i = 0; i < bucket.size(); ++i) {
+        ASSERT(taken[slots[i]] == 0);
+        taken[slots[i]] = bucket[i] + 1;
+      }
+      break;
+    }
+  }
+
+  for (uint32_t s = 0; s < size; ++s) {
+    ASSERT(taken[s] > 0);
+    const Entry & entry = e[taken[s] - 1];
+    const uint32_t begin = r.size();
+    r.resize(begin + entry.first.size() / sizeof(uint32_t) + 1, 0);
+    memcpy(&r[begin], entry.first.data(), entry.first.size());
+
+    uint32_t * const t = &r[kHeader + buckets + s * kSlot];
+    t[0] = begin * sizeof(uint32_t);
+    t[1] = entry.first.size();
+    t[2] = entry.second;
+  }
+}
+
+} //end of filters namespace
+} //end of http namespace
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#ifndef PERFECT_HASH_H
+#define PERFECT_HASH_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <cstring>
+
+#include <stdint.h>
+
+#include "my-assert.h"
+
+namespace http {
+namespace filters {
+
+/*
+ * Minimal perfect hash from names to values, built once by hash and
+ * displace and flattened into 32 bit words, so it is used in place:
+ *
+ *   size, buckets
+ *   buckets times: the seed of the bucket
+ *   size times: byte offset of the name, length, value
+ *   the names, NUL terminated, padded to a word.
+ *
+ * A name picks its bucket with seed 0, then its slot with the seed of
+ * that bucket. Every slot holds exactly one name, so a lookup hashes
+ * twice and compares once.
+ */
+struct PerfectHash {
+  typedef std::pair< std::string, uint32_t > Entry;
+  typedef std::vector< Entry > Entries;
+
+  static const uint32_t kHeader = 2;
+  static const uint32_t kSlot = 3;
+
+  const uint32_t * const t_;
+
+  explicit PerfectHash(const uint32_t * const t) : t_(t) {
+    ASSERT(t != NULL);
+  }
+
+  inline uint32_t size(void) const { return t_[0]; }
+  inline uint32_t buckets(void) const { return t_[1]; }
+
+  inline const uint32_t * slot(const uint32_t i) const {
+    ASSERT(i < size());
+    return t_ + kHeader + buckets() + i * kSlot;
+  }
+
+  /*
+   * FNV-1a from a seeded basis, then mixed: names differing in their last
+   * byte alone would otherwise land in slots no seed tells apart.
+   */
+  static inline uint32_t Hash(const char * const p, const uint32_t l,
+      const uint32_t s) {
+    uint32_t h = 2166136261u ^ (s * 2654435761u);
+    for (uint32_t i = 0; i < l; ++i) {
+      h = (h ^ static_cast< uint8_t >(p[i])) * 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    return h ^ (h >> 16);
+  }
+
+  inline bool find(const char * const p, const uint32_t l,
+      uint32_t & v) const {
+    if (size() == 0) {
+      return false;
+    }
+    const uint32_t seed = t_[kHeader + Hash(p, l, 0) % buckets()];
+    const uint32_t * const s = slot(Hash(p, l, seed) % size());
+    if (s[1] != l || memcmp(reinterpret_cast< const char * >(t_) + s[0],
+          p, l) != 0) {
+      return false;
+    }
+    v = s[2];
+    return true;
+  }
+
+  //names have to be distinct.
+  static void Build(const Entries &, std::vector< uint32_t > &);
+};
+
+} //end of filters namespace
+} //end of http namespace
+
+#endif //PERFECT_HASH_H
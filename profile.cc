@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#include <sstream>
+
+#include <cstring>
+
+#include "automaton.h"
+#include "hash-set.h"
+#include "profile.h"
+
+namespace http {
+namespace filters {
+
+static void Append(std::ostream & o, const uint8_t k, const uint32_t v,
+    const char * const p, const uint32_t l) {
+  switch (k) {
+  case Operands::kMemory:
+  case Operands::kNeedle:
+    o << " " << l << ":";
+    o.write(p != NULL ? p : "", l);
+    break;
+  case Operands::kValue:
+  case Operands::kMode:
+    o << " " << v;
+    break;
+  default: //addresses change from one build to the next.
+    break;
+  }
+}
+
+/*
+ * kContainsMany* counts under the key of the single needle predicate it
+ * replaces, so a profile is valid whether automata are built or not.
+ */
+static bool Single(std::ostream & o, const Program & m,
+    const Operation & p) {
+  uint32_t op = Opcodes::kNull;
+  bool named = true;
+  switch (p.op) {
+  case Opcodes::kContainsManyDomain:
+    op = Opcodes::kContainsDomain;
+    named = false;
+    break;
+  case Opcodes::kContainsManyPath:
+    op = Opcodes::kContainsPath;
+    named = false;
+    break;
+  case Opcodes::kContainsManyQueryParameter:
+    op = Opcodes::kContainsQueryParameter;
+    break;
+  case Opcodes::kContainsManyHeader:
+    op = Opcodes::kContainsHeader;
+    break;
+  case Opcodes::kContainsManyCookie:
+    op = Opcodes::kContainsCookie;
+    break;
+  default:
+    return false;
+  }
+
+  const char * const n = Automaton(m.pointer(p.b)).needle(p.c);
+  const uint32_t l = strlen(n);
+  o << op;
+  if (named) {
+    Append(o, Operands::kMemory, p.a, m.pointer(p.a), p.la);
+    Append(o, Operands::kMemory, 0, n, l);
+  } else {
+    Append(o, Operands::kMemory, 0, n, l);
+    Append(o, Operands::kValue, l, NULL, 0);
+  }
+  Append(o, Operands::kValue, 0, NULL, 0);
+  return true;
+}
+
+std::string Profile::Key(const Program & p, const Operation & o) {
+  const Operands k = Operands::Of(o.op);
+  std::stringstream ss;
+  if (Single(ss, p, o)) {
+    return ss.str();
+  }
+  //sets are told apart by their contents.
+  if (o.op == Opcodes::kEqualDomainSet || o.op == Opcodes::kEqualPathSet) {
+    const HashSet s(p.pointer(o.a));
+    ss << o.op << " " << s.size() << "#" << s.digest();
+    return ss.str();
+  }
+  ss << o.op;
+  Append(ss, k.a, o.a, p.pointer(o.a), o.la);
+  Append(ss, k.b, o.b, p.pointer(o.b), o.lb);
+  Append(ss, k.c, o.c, NULL, 0);
+  return ss.str();
+}
+
+void Profile::add(const Program & p, const Counters & c) {
+  ASSERT(c.empty() || c.size() == p.size());
+  for (uint32_t i = 0; i < c.size(); ++i) {
+    if (c[i].executions == 0) {
+      continue;
+    }
+    Counter & k = map_[Key(p, p[i])];
+    k.executions += c[i].executions;
+    k.trues += c[i].trues;
+  }
+}
+
+void Profile::add(const Profile & p) {
+  const Map::const_iterator END = p.map_.end();
+  for (Map::const_iterator it = p.map_.begin(); it != END; ++it) {
+    Counter & k = map_[it->first];
+    k.executions += it->second.executions;
+    k.trues += it->second.trues;
+  }
+}
+
+const Counter * Profile::find(const std::string & k) const {
+  const Map::const_iterator it = map_.find(k);
+  return it != map_.end() ? &it->second : NULL;
+}
+
+//executions, trues, key size and key.
+void Profile::write(std::ostream & o) const {
+  const Map::const_iterator END = map_.end();
+  for (Map::const_iterator it = map_.begin(); it != END; ++it) {
+    o << it->second.executions << " " << it->second.trues << " "
+      << it->first.size() << " " << it->first << "\n";
+  }
+}
+
+bool Profile::read(std::istream & i) {
+  Counter c;
+  uint32_t s = 0;
+  while (i >> c.executions >> c.trues >> s) {
+    if (i.get() != ' ') {
+      return false;
+    }
+    std::string k(s, '\0');
+    if ( ! i.read(&k[0], s) || i.get() != '\n') {
+      return false;
+    }
+    Counter & e = map_[k];
+    e.executions += c.executions;
+    e.trues += c.trues;
+  }
+  return i.eof();
+}
+
+} //end of filters namespace
+} //end of http namespace
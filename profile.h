@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "my-assert.h"
+
+#include "program.h"
+
+namespace http {
+namespace filters {
+
+struct Counter {
+  uint64_t executions;
+  uint64_t trues;
+
+  Counter(void) : executions(0), trues(0) { }
+};
+
+//one per instruction, see VM< I >::profile.
+typedef std::vector< Counter > Counters;
+
+/*
+ * Counters by predicate instead of by address, so they survive rebuilding
+ * the program: a predicate is its opcode plus its memory and value
+ * operands. It is written and read back one predicate per line.
+ */
+struct Profile {
+  typedef std::map< std::string, Counter > Map;
+
+  Map map_;
+
+  //adds what a VM counted running the program.
+  void add(const Program &, const Counters &);
+
+  void add(const Profile &);
+
+  const Counter * find(const std::string &) const;
+
+  void write(std::ostream &) const;
+
+  bool read(std::istream &);
+
+  //the key of an operation of the program.
+  static std::string Key(const Program &, const Operation &);
+};
+
+} //end of filters namespace
+} //end of http namespace
+
+#endif //PROFILE_H
@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#include <cstring>
+
+#include "automaton.h"
+#include "program.h"
+
+namespace http {
+namespace filters {
+
+Operands Operands::Of(const uint32_t op) {
+  Operands o;
+  o.a = o.b = o.c = kNone;
+
+  switch (op) {
+  case Opcodes::kExecute:
+    o.a = kMode;
+    o.b = kAddress;
+    o.c = kValue;
+    break;
+
+  case Opcodes::kExecuteSingle:
+  case Opcodes::kJump:
+  case Opcodes::kJumpIfTrue:
+  case Opcodes::kJumpIfFalse:
+    o.a = kAddress;
+    break;
+
+  case Opcodes::kPrintError:
+  case Opcodes::kPrintDebug:
+    o.a = o.b = kMemory;
+    o.c = kMode;
+    break;
+
+  case Opcodes::kContainsDomain:
+  case Opcodes::kStartsWithDomain:
+  case Opcodes::kContainsPath:
+  case Opcodes::kStartsWithPath:
+    o.a = kNeedle;
+    o.b = o.c = kValue;
+    break;
+
+  case Opcodes::kIsMethod:
+  case Opcodes::kIsScheme:
+  case Opcodes::kEqualDomain:
+  case Opcodes::kNotEqualDomain:
+  case Opcodes::kEqualPath:
+  case Opcodes::kNotEqualPath:
+  case Opcodes::kGreaterThanQueryParameter:
+  case Opcodes::kLessThanQueryParameter:
+  case Opcodes::kGreaterThanHeader:
+  case Opcodes::kLessThanHeader:
+  case Opcodes::kGreaterThanCookie:
+  case Opcodes::kLessThanCookie:
+    o.a = kMemory;
+    o.b = o.c = kValue;
+    break;
+
+  case Opcodes::kExistsGreaterThanQueryParameter:
+  case Opcodes::kExistsLessThanQueryParameter:
+  case Opcodes::kExistsGreaterThanHeader:
+  case Opcodes::kExistsLessThanHeader:
+  case Opcodes::kExistsGreaterThanCookie:
+  case Opcodes::kExistsLessThanCookie:
+    o.a = kMemory;
+    o.b = kValue;
+    o.c = kMode;
+    break;
+
+  case Opcodes::kExistsQueryParameter:
+  case Opcodes::kExistsHeader:
+  case Opcodes::kExistsCookie:
+    o.a = kMemory;
+    break;
+
+  case Opcodes::kContainsQueryParameter:
+  case Opcodes::kGreaterThanAfterQueryParameter:
+  case Opcodes::kLessThanAfterQueryParameter:
+  case Opcodes::kStartsWithQueryParameter:
+  case Opcodes::kContainsHeader:
+  case Opcodes::kContainsHeaderI:
+  case Opcodes::kGreaterThanAfterHeader:
+  case Opcodes::kLessThanAfterHeader:
+  case Opcodes::kStartsWithHeader:
+  case Opcodes::kContainsCookie:
+  case Opcodes::kGreaterThanAfterCookie:
+  case Opcodes::kLessThanAfterCookie:
+    o.a = kMemory;
+    o.b = kNeedle;
+    o.c = kValue;
+    break;
+
+  case Opcodes::kEqualQueryParameter:
+  case Opcodes::kNotEqualQueryParameter:
+  case Opcodes::kEqualHeader:
+  case Opcodes::kNotEqualHeader:
+  case Opcodes::kEqualHeaderI:
+  case Opcodes::kNotEqualHeaderI:
+  case Opcodes::kEqualCookie:
+  case Opcodes::kNotEqualCookie:
+    o.a = o.b = kMemory;
+    o.c = kValue;
+    break;
+
+  case Opcodes::kContainsManyDomain:
+  case Opcodes::kContainsManyPath:
+  case Opcodes::kContainsManyQueryParameter:
+  case Opcodes::kContainsManyHeader:
+  case Opcodes::kContainsManyCookie:
+    o.a = kMemory;
+    o.b = kBlob;
+    o.c = kValue;
+    break;
+
+  case Opcodes::kEqualDomainSet:
+  case Opcodes::kEqualPathSet:
+  case Opcodes::kMatches:
+    o.a = kBlob;
+    break;
+
+  case Opcodes::kExistsContainsQueryParameter:
+  case Opcodes::kExistsStartsWithQueryParameter:
+  case Opcodes::kExistsContainsHeader:
+  case Opcodes::kExistsStartsWithHeader:
+  case Opcodes::kExistsContainsCookie:
+    o.a = kMemory;
+    o.b = kNeedle;
+    o.c = kMode;
+    break;
+
+  case Opcodes::kExistsEqualQueryParameter:
+  case Opcodes::kExistsEqualHeader:
+  case Opcodes::kExistsEqualCookie:
+    o.a = o.b = kMemory;
+    o.c = kMode;
+    break;
+
+  default:
+    break;
+  }
+
+  return o;
+}
+
+const uint64_t CompactCode::kWide;
+const uint32_t CompactCode::kABits;
+const uint32_t CompactCode::kBBits;
+const uint32_t CompactCode::kCBits;
+
+CompactCode::CompactCode(const Code & c) {
+  ASSERT(c.size % kSize == 0);
+  words.reserve(c.size / kSize);
+  for (uint32_t i = 0; i < c.size; i += kSize) {
+    push(c[i], c[i + 1], c[i + 2], c[i + 3]);
+  }
+}
+
+void CompactCode::push(const uint32_t op, const uint32_t a,
+    const uint32_t b, const uint32_t c) {
+  ASSERT(op < kWide);
+  if (a >> kABits == 0 && b >> kBBits == 0 && c >> kCBits == 0) {
+    words.push_back(op
+        | static_cast< uint64_t >(a) << 8
+        | static_cast< uint64_t >(b) << (8 + kABits)
+        | static_cast< uint64_t >(c) << (8 + kABits + kBBits));
+  } else {
+    words.push_back(op | kWide | static_cast< uint64_t >(wide.size()) << 8);
+    wide.push_back(a);
+    wide.push_back(b);
+    wide.push_back(c);
+  }
+}
+
+void CompactCode::decode(const uint32_t i, uint32_t * const d) const {
+  ASSERT(i < words.size());
+  const uint64_t w = words[i];
+  d[0] = w & (kWide - 1);
+  if (w & kWide) {
+    const uint32_t j = w >> 8;
+    ASSERT(j + 2 < wide.size());
+    d[1] = wide[j];
+    d[2] = wide[j + 1];
+    d[3] = wide[j + 2];
+  } else {
+    d[1] = (w >> 8) & ((1 << kABits) - 1);
+    d[2] = (w >> (8 + kABits)) & ((1 << kBBits) - 1);
+    d[3] = w >> (8 + kABits + kBBits);
+  }
+}
+
+void CompactCode::decode(uint32_t * const d) const {
+  for (uint32_t i = 0; i < words.size(); ++i) {
+    decode(i, d + i * kSize);
+  }
+}
+
+const uint32_t Operation::kNoMemo;
+
+const Operation Program::Return(Opcodes::kReturn);
+
+/*
+ * Everything that produces a result through VM::memo, or kExecute through
+ * its kReturn.
+ */
+bool Program::Memoized(const uint32_t op) {
+  switch (op) {
+  case Opcodes::kNull:
+  case Opcodes::kSkip:
+  case Opcodes::kExecuteSingle:
+  case Opcodes::kReturn:
+  case Opcodes::kHalt:
+  case Opcodes::kNone:
+  case Opcodes::kAnd:
+  case Opcodes::kOr:
+  case Opcodes::kNot:
+  case Opcodes::kPrintError:
+  case Opcodes::kPrintDebug:
+  case Opcodes::kJump:
+  case Opcodes::kJumpIfTrue:
+  case Opcodes::kJumpIfFalse:
+  case Opcodes::kMatches:
+    return false;
+
+  default:
+    return true;
+  }
+}
+
+static inline void Resolve(const Memory & m, const uint32_t o,
+    uint32_t & l) {
+  if (m.size == 0) {
+    ASSERT(o == 0);
+    return;
+  }
+  ASSERT(o < m.size);
+  l = strlen(m + o);
+}
+
+Program::Program(const Code & c, const Memory & m) : memos_(0),
+  memory_(NULL) {
+  decode(c, m);
+}
+
+Program::Program(const CompactCode & c, const Memory & m) : memos_(0),
+  memory_(NULL) {
+  std::vector< uint32_t > d(c.size() * kSize);
+  c.decode(d.data());
+  decode(Code(d.data(), d.size()), m);
+}
+
+void Program::decode(const Code & c, const Memory & m) {
+  ASSERT(c.size % kSize == 0);
+  const uint32_t size = c.size / kSize;
+  operations_.reserve(size);
+  if (m.size > 0) {
+    memory_ = m + 0;
+  }
+  Memos memos;
+  std::map< uint32_t, uint32_t > blobs;
+
+  for (uint32_t i = 0; i < size; ++i) {
+    const uint32_t * begin = c + (i * kSize);
+
+    //simple 1 instruction GOTO
+    for (uint32_t j = 0; begin[0] == Opcodes::kExecuteSingle; ++j) {
+      ASSERT(j < size); //prevents infinite loop.
+      ASSERT(begin[1] < size);
+      begin = c + (begin[1] * kSize);
+    }
+
+    ASSERT(begin[0] < Opcodes::kUpperBound);
+
+    Operation o(begin[0]);
+    o.a = begin[1];
+    o.b = begin[2];
+    o.c = begin[3];
+
+    const Operands k = Operands::Of(o.op);
+    if (k.a == Operands::kMemory || k.a == Operands::kNeedle) {
+      Resolve(m, o.a, o.la);
+    } else if (k.a == Operands::kBlob) {
+      ASSERT(o.a < m.size);
+    }
+    if (k.b == Operands::kMemory || k.b == Operands::kNeedle) {
+      Resolve(m, o.b, o.lb);
+    } else if (k.b == Operands::kBlob) {
+      ASSERT(o.b < m.size);
+    }
+
+    /*
+     * the assembler unifies memory, so equal operands mean the same
+     * predicate. kFlip depends on what ran before it, it is never shared.
+     */
+    if (o.op == Opcodes::kFlip) {
+      o.memo = memos_++;
+    } else if (Memoized(o.op)) {
+      const Key key(Pair(o.op, o.a), Pair(o.b, o.c));
+      const std::pair< Memos::iterator, bool > r =
+        memos.insert(std::make_pair(key, memos_));
+      if (r.second) {
+        ++memos_;
+      }
+      o.memo = r.first->second;
+    }
+
+    //lets the first predicate scanned answer the others.
+    if (k.b == Operands::kBlob) {
+      const std::pair< std::map< uint32_t, uint32_t >::iterator, bool > r =
+        blobs.insert(std::make_pair(o.b, scans_.size()));
+      if (r.second) {
+        scans_.push_back(std::vector< uint32_t >(
+              Automaton(pointer(o.b)).needles(), Operation::kNoMemo));
+      }
+      o.scan = r.first->second;
+      ASSERT(o.c < scans_[o.scan].size());
+      scans_[o.scan][o.c] = o.memo;
+    }
+
+    operations_.push_back(o);
+  }
+}
+
+} //end of filters namespace
+} //end of http namespace
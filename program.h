@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <map>
+#include <vector>
+
+#include <stdint.h>
+
+#include "my-assert.h"
+
+#include "array.h"
+#include "opcodes.h"
+
+namespace http {
+namespace filters {
+
+typedef util::Array< const uint32_t > Code;
+typedef util::Array< const char > Memory;
+
+static const int kSize = 4;
+
+/*
+ * 8 byte encoding of Code: the opcode in the low byte, then a and b in 20
+ * bits each and c in 16 bits. An instruction whose operands do not fit
+ * sets kWide in the opcode byte and keeps the index of its operands in
+ * the side table instead, so every instruction is still one word and code
+ * addresses are unchanged.
+ */
+struct CompactCode {
+  typedef std::vector< uint64_t > Words;
+  typedef std::vector< uint32_t > Wide;
+
+  static const uint64_t kWide = 0x80;
+  static const uint32_t kABits = 20;
+  static const uint32_t kBBits = 20;
+  static const uint32_t kCBits = 16;
+
+  Words words;
+  Wide wide;
+
+  CompactCode(void) { }
+
+  CompactCode(const Code &);
+
+  inline uint32_t size(void) const { return words.size(); }
+
+  inline uint32_t bytes(void) const {
+    return words.size() * sizeof(uint64_t) + wide.size() * sizeof(uint32_t);
+  }
+
+  void push(const uint32_t, const uint32_t, const uint32_t, const uint32_t);
+
+  //writes the kSize words of instruction i into d.
+  void decode(const uint32_t, uint32_t * const) const;
+
+  //back into Code, d has to hold size() * kSize words.
+  void decode(uint32_t * const) const;
+};
+
+/*
+ * Describes what each of the three operands of an opcode refers to.
+ */
+struct Operands {
+  enum KINDS {
+    kNone,
+    kValue, //immediate value: length, offset, number or counter.
+    kMemory, //Memory offset of a string.
+    kAddress, //Code address.
+    kMode, //ExecutionMode.
+    kBlob, //Memory offset of a word aligned table, see Automaton, HashSet.
+    kNeedle, //Memory offset of a string searched for, see Needle.
+  };
+
+  uint8_t a;
+  uint8_t b;
+  uint8_t c;
+
+  static Operands Of(const uint32_t);
+};
+
+/*
+ * A decoded instruction: the lengths of memory operands already measured
+ * and kExecuteSingle chains already followed. Memory operands stay offsets,
+ * see Program::pointer, so an operation is 32 bytes, two per cache line.
+ */
+struct Operation {
+  static const uint32_t kNoMemo = 0xFFFFFFFF;
+
+  uint32_t op;
+  uint32_t a;
+  uint32_t b;
+  uint32_t c;
+
+  uint32_t la;
+  uint32_t lb;
+
+  //dense id its result is memoized by, shared by identical predicates.
+  uint32_t memo;
+  //kContainsMany*: index of its automaton in Program::scans_.
+  uint32_t scan;
+
+  Operation(void) : op(Opcodes::kNull), a(0), b(0), c(0),
+    la(0), lb(0), memo(kNoMemo), scan(kNoMemo) { }
+
+  Operation(const uint32_t op) : op(op), a(0), b(0), c(0),
+    la(0), lb(0), memo(kNoMemo), scan(kNoMemo) { }
+};
+
+/*
+ * Immutable, pre-decoded form of a Code and Memory pair. It is built once
+ * and can be shared read-only by any number of VMs. The Memory it was built
+ * from must outlive it.
+ */
+struct Program {
+  typedef std::vector< Operation > Operations;
+  typedef std::pair< uint32_t, uint32_t > Pair;
+  typedef std::pair< Pair, Pair > Key;
+  typedef std::map< Key, uint32_t > Memos;
+  //per automaton, the memo id answering each of its needles.
+  typedef std::vector< std::vector< uint32_t > > Scans;
+
+  static const Operation Return;
+
+  Operations operations_;
+  uint32_t memos_;
+  Scans scans_;
+  //the Memory the operations refer to, NULL when it is empty.
+  const char * memory_;
+
+  Program(const Code &, const Memory &);
+
+  Program(const CompactCode &, const Memory &);
+
+  void decode(const Code &, const Memory &);
+
+  inline uint32_t size(void) const { return operations_.size(); }
+
+  //how many distinct memoized results the program has.
+  inline uint32_t memos(void) const { return memos_; }
+
+  static bool Memoized(const uint32_t);
+
+  //what a memory, needle or blob operand refers to.
+  inline const char * pointer(const uint32_t o) const {
+    return memory_ + o;
+  }
+
+  inline const Operation & operator [] (const uint32_t i) const {
+    ASSERT(i < operations_.size());
+    return operations_[i];
+  }
+};
+
+} //end of filters namespace
+} //end of http namespace
+
+#endif //PROGRAM_H
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#include "requirements.h"
+
+namespace http {
+namespace filters {
+
+const uint32_t Requirements::kBits;
+
+static inline bool EndsWith(const std::string & s, const char * const e) {
+  const size_t l = strlen(e);
+  return s.size() >= l && s.compare(s.size() - l, l, e) == 0;
+}
+
+static inline bool IsPrint(const Node * const n) {
+  const Op * const o = dynamic_cast< const Op * >(n);
+  return o != NULL && (o->name == "printError" || o->name == "printDebug");
+}
+
+void Requirements::add(const Tree & t) {
+  const Mask m = touches(t.root());
+  touches_.push_back(m);
+  needs_.push_back(t.root() != NULL && Pure(t.root())
+      ? needs(t.root(), ExecutionMode::kNone) : 0);
+  all_ |= m;
+}
+
+void Requirements::remove(const uint32_t e) {
+  ASSERT(e < touches_.size());
+  touches_[e] = needs_[e] = 0;
+  all_ = 0;
+  const Masks::const_iterator END = touches_.end();
+  for (Masks::const_iterator it = touches_.begin(); it != END; ++it) {
+    all_ |= *it;
+  }
+}
+
+Requirements::Mask Requirements::bit(const uint32_t c,
+    const std::string & n) {
+  const Name k = Key(c, n);
+  const Bits::const_iterator it = bits_.find(k);
+  if (it != bits_.end()) {
+    return Bit(it->second);
+  }
+  if (kFixed + names_.size() >= kBits) {
+    return Bit(c);
+  }
+  const uint32_t b = kFixed + names_.size();
+  names_.push_back(k);
+  bits_.insert(std::make_pair(names_.back(), b));
+  return Bit(b);
+}
+
+Requirements::Mask Requirements::touches(const Node * n) {
+  Mask m = 0;
+  for (; n != NULL; n = n->next) {
+    const BinaryNode * const b = dynamic_cast< const BinaryNode * >(n);
+    if (b != NULL) {
+      m |= touches(b->child);
+      continue;
+    }
+    const Op * const o = dynamic_cast< const Op * >(n);
+    if (o == NULL) {
+      continue;
+    }
+    const uint32_t c = Component(o->name);
+    if (c == kHeaders || c == kCookies || c == kParameters) {
+      ASSERT( ! o->parameters.empty());
+      m |= bit(c, o->parameters[0]);
+      //cookies come from their header.
+      if (c == kCookies) {
+        m |= bit(kHeaders, "Cookie");
+      }
+    } else if (c < kFixed) {
+      m |= Bit(c);
+    }
+  }
+  return m;
+}
+
+/*
+ * The names a list is false without. An And list needs what any of its
+ * items needs, an Or list what all of them need and a kNone list what its
+ * last item needs. Negated items need nothing.
+ */
+Requirements::Mask Requirements::needs(const Node * n,
+    const ExecutionMode::MODES m) const {
+  Mask r = 0;
+  bool first = true, negated = false;
+  for (; n != NULL; n = n->next) {
+    if (n->type() == NodeTypes::kNot) {
+      negated = true;
+      continue;
+    }
+    if (IsPrint(n)) {
+      continue;
+    }
+    const Mask i = negated ? 0 : need(n);
+    negated = false;
+    switch (m) {
+    case ExecutionMode::kAnd: r |= i; break;
+    case ExecutionMode::kOr: r = first ? i : r & i; break;
+    default: r = i; break;
+    }
+    first = false;
+  }
+  return r;
+}
+
+Requirements::Mask Requirements::need(const Node * const n) const {
+  switch (n->type()) {
+  case NodeTypes::kAnd:
+  case NodeTypes::kOr:
+    {
+      const BinaryNode * const b = dynamic_cast< const BinaryNode * >(n);
+      ASSERT(b != NULL);
+      return needs(b->child, n->type() == NodeTypes::kAnd
+          ? ExecutionMode::kAnd : ExecutionMode::kOr);
+    }
+
+  case NodeTypes::kOp:
+    {
+      const Op * const o = dynamic_cast< const Op * >(n);
+      ASSERT(o != NULL);
+      const uint32_t c = Component(o->name);
+      if (c != kHeaders && c != kCookies && c != kParameters) {
+        return 0;
+      }
+      //past the last bit a name cannot be told missing.
+      const Bits::const_iterator it = bits_.find(Key(c, o->parameters[0]));
+      return it != bits_.end() ? Bit(it->second) : 0;
+    }
+
+  default:
+    return 0;
+  }
+}
+
+//kFixed for what reads nothing from the request.
+uint32_t Requirements::Component(const std::string & n) {
+  if (EndsWith(n, "Header") || EndsWith(n, "HeaderI")) {
+    return kHeaders;
+  } else if (EndsWith(n, "Cookie")) {
+    return kCookies;
+  } else if (EndsWith(n, "QueryParameter")) {
+    return kParameters;
+  } else if (EndsWith(n, "Domain")) {
+    return kHost;
+  } else if (EndsWith(n, "Path")) {
+    return kPath;
+  } else if (n == "isMethod") {
+    return kMethod;
+  } else if (n == "isScheme") {
+    return kScheme;
+  }
+  return kFixed;
+}
+
+bool Requirements::Pure(const Node * n) {
+  for (; n != NULL; n = n->next) {
+    const BinaryNode * const b = dynamic_cast< const BinaryNode * >(n);
+    if (IsPrint(n) || (b != NULL && ! Pure(b->child))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} //end of filters namespace
+} //end of http namespace
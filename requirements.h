@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#ifndef REQUIREMENTS_H
+#define REQUIREMENTS_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <cstring>
+
+#include <stdint.h>
+
+#include "my-assert.h"
+
+#include "fold.h"
+
+#include "opcodes.h"
+#include "representation.h"
+
+namespace http {
+namespace filters {
+
+/*
+ * What the entries of a forest read from a request, so an implementation
+ * fetches all of it in a single pass, and which names an entry cannot
+ * match without, so it is not run when one of them is missing.
+ *
+ * A Mask has a bit per component below kFixed, then one per header,
+ * cookie or query parameter name in names_. Names past the last bit fall
+ * back to kHeaders, kCookies or kParameters: all of them.
+ *
+ * Every header, cookie and query parameter predicate is false when its
+ * name is missing, and only entries without prints are skipped. Header
+ * names are kept folded to lower case, see fold.h.
+ */
+struct Requirements {
+  typedef uint64_t Mask;
+  typedef std::pair< uint32_t, std::string > Name;
+  typedef std::vector< Name > Names;
+  typedef std::map< Name, uint32_t > Bits;
+  typedef std::vector< Mask > Masks;
+
+  enum COMPONENTS {
+    kMethod,
+    kScheme,
+    kHost,
+    kPath,
+    kHeaders,
+    kCookies,
+    kParameters,
+    kFixed,
+  };
+
+  static const uint32_t kBits = 64;
+
+  //the name of every bit from kFixed on, with its component.
+  Names names_;
+  Bits bits_;
+  //per entry, what it may read and which names it needs.
+  Masks touches_;
+  Masks needs_;
+  //what any entry may read.
+  Mask all_;
+
+  Requirements(void) : all_(0) { }
+
+  static inline Mask Bit(const uint32_t b) {
+    ASSERT(b < kBits);
+    return static_cast< Mask >(1) << b;
+  }
+
+  //the next entry.
+  void add(const Tree &);
+
+  //entry e no longer reads anything, its names keep their bits.
+  void remove(const uint32_t);
+
+  inline bool skips(const uint32_t e, const Mask present) const {
+    ASSERT(e < needs_.size());
+    return (needs_[e] & ~present) != 0;
+  }
+
+  //whether any entry reads the name l bytes long at p of component c.
+  inline bool wants(const uint32_t c, const char * const p,
+      const uint32_t l) const {
+    const Names::const_iterator END = names_.end();
+    for (Names::const_iterator it = names_.begin(); it != END; ++it) {
+      if (it->first == c && it->second.size() == l
+          && (c == kHeaders ? util::EqualFolded(p, it->second.data(), l)
+            : memcmp(it->second.data(), p, l) == 0)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static inline Name Key(const uint32_t c, const std::string & n) {
+    return Name(c, c == kHeaders ? util::Fold(n) : n);
+  }
+
+  Mask bit(const uint32_t, const std::string &);
+
+  Mask touches(const Node *);
+
+  Mask needs(const Node *, const ExecutionMode::MODES) const;
+
+  Mask need(const Node * const) const;
+
+  static uint32_t Component(const std::string &);
+
+  static bool Pure(const Node *);
+};
+
+} //end of filters namespace
+} //end of http namespace
+
+#endif //REQUIREMENTS_H
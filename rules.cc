@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#include "my-assert.h"
+
+#include "array.h"
+#include "rules.h"
+
+namespace http {
+namespace filters {
+
+void BuildRules(Forest & f) {
+  {
+    Tree t;
+    t.addAnd();
+      CHILD_OP(t, "isMethod", "GET");
+      OP(t, "isScheme", "http");
+      t.parent();
+    f.push_back(t);
+  }
+
+  {
+    Tree t;
+    t.addAnd();
+      CHILD_OP(t, "existsHeader", "User-Agent");
+      OP(t, "containsHeaderI", "User-Agent", "Firefox");
+      t.parent();
+    f.push_back(t);
+  }
+
+  {
+    Tree t;
+    OP(t, "containsDomain", ".yahoo.com");
+    f.push_back(t);
+  }
+
+  {
+    Tree t;
+    OP(t, "equalPath", "search");
+    f.push_back(t);
+  }
+
+  {
+    Tree t;
+    OP(t, "containsQueryParameter", "state", "california");
+    f.push_back(t);
+  }
+
+  {
+    Tree t;
+    OP(t, "startsWithQueryParameter", "city", "san");
+    f.push_back(t);
+  }
+}
+
+void BuildNames(std::vector< std::string > & n) {
+  const char * const names [] = {
+    "http get", "firefox", "yahoo domain", "slash-search",
+    "california", "city starts with san",
+  };
+  n.assign(names, names + ARRAY_SIZE(names));
+}
+
+} //end of filters namespace
+} //end of http namespace
@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2015, Yahoo Inc. All rights reserved.
+ * Copyrights licensed under the New BSD License.
+ * See the accompanying LICENSE file for terms.
+ */
+
+#ifndef RULES_H
+#define RULES_H
+
+#include <string>
+#include <vector>
+
+#include "representation.h"
+
+namespace http {
+namespace filters {
+
+/*
+ * The rule set of the plugin, shared with the ahead of time generator so
+ * both backends filter on the very same entries.
+ */
+void BuildRules(Forest &);
+
+//the name of every entry BuildRules adds, in the same order.
+void BuildNames(std::vector< std::string > &);
+
+} //end of filters namespace
+} //end of http namespace
+
+#endif //RULES_H
@@ -19,6 +19,10 @@ struct StringView {
   StringView(void) : pointer(NULL),
     length(1) { }
 
+  //a NUL terminated string, for callers without its length.
+  StringView(const char * const p) :
+    pointer(p), length(p == NULL ? 0 : strlen(p)) { }
+
   StringView(const char * const p, const size_t l) :
     pointer(p), length(p == NULL ? 0 : l) {
     ASSERT(p == NULL || strlen(pointer) >= length);
@@ -30,7 +34,7 @@ struct StringView {
 
   bool operator == (const StringView & s) const {
     return length == s.length
-      && memcmp(pointer, s.pointer, length);
+      && memcmp(pointer, s.pointer, length) == 0;
   }
 
   std::string str(void) const {
@@ -15,32 +15,56 @@ namespace http {
 namespace filters {
 
 struct Contains {
+  const Needle n;
+  Contains(const Needle & n) : n(n) {
+    ASSERT(n.pointer != NULL);
+  }
+  template < class I >
+  bool operator () (const I & i) const {
+    const char * const begin = i->pointer,
+          * const end = begin + i->length;
+    return n.find(begin, end) != end;
+  }
+};
+
+struct Equal {
   const char * const p;
   const size_t s;
-  Contains(const char * const p, const size_t s) :
+  Equal(const char * const p, const size_t s) :
     p(p), s(s) {
     ASSERT(p != NULL);
     ASSERT(s <= strlen(p));
   }
   template < class I >
+  bool operator () (const I & i) const {
+    return s == i->length && memcmp(p, i->pointer, s) == 0;
+  }
+};
+
+//the I variants: what they compare with is folded already.
+struct ContainsI {
+  const Needle n;
+  ContainsI(const Needle & n) : n(n) {
+    ASSERT(n.pointer != NULL);
+  }
+  template < class I >
   bool operator () (const I & i) const {
     const char * const begin = i->pointer,
           * const end = begin + i->length;
-    return std::search(begin, end, p, p + s) != end;
+    return n.findFolded(begin, end) != end;
   }
 };
 
-struct Equal {
+struct EqualI {
   const char * const p;
   const size_t s;
-  Equal(const char * const p, const size_t s) :
+  EqualI(const char * const p, const size_t s) :
     p(p), s(s) {
     ASSERT(p != NULL);
-    ASSERT(s <= strlen(p));
   }
   template < class I >
   bool operator () (const I & i) const {
-    return s == i->length && memcmp(p, i->pointer, s) == 0;
+    return s == i->length && util::EqualFolded(i->pointer, p, s);
   }
 };
 
@@ -59,20 +83,18 @@ struct GreaterThan {
 
 template < class T >
 struct GreaterThanAfter {
-  const char * const p;
-  const size_t s;
+  const Needle n;
   const T t;
-  GreaterThanAfter(const char * const p, const size_t s,
-      const T & t) : p(p), s(s), t(t) {
-    ASSERT(s <= strlen(p));
+  GreaterThanAfter(const Needle & n, const T & t) : n(n), t(t) {
+    ASSERT(n.pointer != NULL);
   }
   template < class I >
   bool operator () (const I & i) const {
     const char * const begin = i->pointer,
           * const end = begin + i->length,
-          * iterator = std::search(begin, end, p, p + s);
+          * iterator = n.find(begin, end);
     while (iterator != end) {
-      iterator += s;
+      iterator += n.length;
       ASSERT(iterator <= end);
       std::istringstream ss(std::string(iterator, end - iterator));
       int64_t c;
@@ -80,7 +102,7 @@ struct GreaterThanAfter {
       if ( ! ss.fail() && c > t) {
         return true;
       }
-      iterator = std::search(iterator, end, p, p + s);
+      iterator = n.find(iterator, end);
     }
     return false;
   }
@@ -101,20 +123,18 @@ struct LessThan {
 
 template < class T >
 struct LessThanAfter{
-  const char * const p;
-  const size_t s;
+  const Needle n;
   const T t;
-  LessThanAfter(const char * const p, const size_t s,
-      const T & t) : p(p), s(s), t(t) {
-    ASSERT(s <= strlen(p));
+  LessThanAfter(const Needle & n, const T & t) : n(n), t(t) {
+    ASSERT(n.pointer != NULL);
   }
   template < class I >
   bool operator () (const I & i) const {
     const char * const begin = i->pointer,
           * const end = begin + i->length,
-          * iterator = std::search(begin, end, p, p + s);
+          * iterator = n.find(begin, end);
     while (iterator != end) {
-      iterator += s;
+      iterator += n.length;
       ASSERT(iterator <= end);
       std::istringstream ss(std::string(iterator, end - iterator));
       int64_t c;
@@ -122,27 +142,23 @@ struct LessThanAfter{
       if ( ! ss.fail() && c < t) {
         return true;
       }
-      iterator = std::search(iterator, end, p, p + s);
+      iterator = n.find(iterator, end);
     }
     return false;
   }
 };
 
 struct StartsWith {
-  const char * const p;
-  const size_t s;
+  const Needle n;
   const size_t o;
-  StartsWith(const char * const p, const size_t s, const size_t o) :
-    p(p), s(s), o(o) {
-    ASSERT(p != NULL);
-    ASSERT(s <= strlen(p));
+  StartsWith(const Needle & n, const size_t o) : n(n), o(o) {
+    ASSERT(n.pointer != NULL);
   }
   template < class I >
   bool operator () (const I & i) const {
     const char * const begin = i->pointer,
           * const end = begin + i->length;
-    return begin != end
-      && std::search(begin, end, p, p + s) == begin + o;
+    return begin != end && n.find(begin, end) == begin + o;
   }
 };
 
@@ -166,40 +182,100 @@ bool Loop(const typename T::Result & r, const U & u) {
 }
 
 bool TSImplementation::ContainsHeader(
-    const char * const a, const char * const b) {
-  return Loop< Headers >(headers()[a], Contains(b, strlen(b)));
+    const util::StringView & a, const Needle & b) {
+  return Loop< Headers >(headers()[a], Contains(b));
 }
 
 bool TSImplementation::EqualHeader(
-    const char * const a, const char * const b) {
-  return Loop< Headers >(headers()[a], Equal(b, strlen(b)));
+    const util::StringView & a, const util::StringView & b) {
+  return Loop< Headers >(headers()[a], Equal(b.pointer, b.length));
 }
 
 bool TSImplementation::GreaterThanHeader(
-    const char * const a, const int64_t b) {
+    const util::StringView & a, const int64_t b) {
   return Loop< Headers >(headers()[a], GreaterThan< int64_t >(b));
 }
 
-bool TSImplementation::GreaterThanAfterHeader(const char * const a,
-    const char * const b, const int64_t c) {
+bool TSImplementation::GreaterThanAfterHeader(const util::StringView & a,
+    const Needle & b, const int64_t c) {
   return Loop< Headers >(headers()[a],
-      GreaterThanAfter< int64_t >(b, strlen(b), c));
+      GreaterThanAfter< int64_t >(b, c));
 }
 
 bool TSImplementation::LessThanHeader(
-    const char * const a, const int64_t b) {
+    const util::StringView & a, const int64_t b) {
   return Loop< Headers >(headers()[a], LessThan< int64_t >(b));
 }
 
-bool TSImplementation::LessThanAfterHeader(const char * const a,
-    const char * const b, const int64_t c) {
+bool TSImplementation::LessThanAfterHeader(const util::StringView & a,
+    const Needle & b, const int64_t c) {
   return Loop< Headers >(headers()[a],
-      LessThanAfter< int64_t >(b, strlen(b), c));
+      LessThanAfter< int64_t >(b, c));
 }
 
 bool TSImplementation::StartsWithHeader(
-    const char * const a, const char * const b, const uint32_t c) {
-  return Loop< Headers >(headers()[a], StartsWith(b, strlen(b), c));
+    const util::StringView & a, const Needle & b, const uint32_t c) {
+  return Loop< Headers >(headers()[a], StartsWith(b, c));
+}
+
+bool TSImplementation::ContainsHeaderI(
+    const util::StringView & a, const Needle & b) {
+  return Loop< Headers >(headers()[a], ContainsI(b));
+}
+
+bool TSImplementation::EqualHeaderI(
+    const util::StringView & a, const util::StringView & b) {
+  return Loop< Headers >(headers()[a], EqualI(b.pointer, b.length));
+}
+
+/*
+ * A single pass over the header fields keeps the ones wanted, the cookies
+ * and the query parameters wanted are the only ones parsed.
+ */
+bool TSImplementation::Prefetch(const Requirements & r,
+    Requirements::Mask & present) {
+  typedef Requirements R;
+  const R::Mask m = r.all_;
+  R::Mask kinds = m;
+  for (uint32_t i = 0; i < r.names_.size(); ++i) {
+    kinds |= R::Bit(r.names_[i].first);
+  }
+
+  if (m & (R::Bit(R::kScheme) | R::Bit(R::kHost) | R::Bit(R::kPath)
+        | R::Bit(R::kParameters))) {
+    url();
+  }
+  if (kinds & R::Bit(R::kHeaders)) {
+    headers_ = Headers(buffer_, location_,
+        m & R::Bit(R::kHeaders) ? NULL : &r);
+  }
+  if (kinds & R::Bit(R::kCookies)) {
+    const Headers::Result c = headers_["cookie"];
+    if (c.second && ! c.first->empty()) {
+      cookies_ = Cookies((*c.first)[0], m & R::Bit(R::kCookies) ? NULL : &r);
+    }
+  }
+  if (kinds & R::Bit(R::kParameters)) {
+    queryParameters_ = QueryParameters(queryParameter(buffer_),
+        m & R::Bit(R::kParameters) ? NULL : &r);
+  }
+  fetched_ = true;
+
+  present = 0;
+  for (uint32_t i = 0; i < r.names_.size(); ++i) {
+    const char * const n = r.names_[i].second.c_str();
+    bool p = false;
+    switch (r.names_[i].first) {
+    case R::kHeaders: p = headers_[n].second; break;
+    case R::kCookies: p = cookies_[n].second; break;
+    case R::kParameters: p = queryParameters_[n].second; break;
+    default: break;
+    }
+    if (p) {
+      present |= R::Bit(R::kFixed + i);
+    }
+  }
+  return true;
 }
 
 bool TSImplementation::IsScheme(
@@ -225,15 +301,15 @@ bool TSImplementation::IsMethod(
 }
 
 bool TSImplementation::ContainsDomain(
-    const char * const a, const uint32_t b) {
-  ASSERT(a != NULL);
-  ASSERT(strlen(a) >= b);
+    const Needle & a, const uint32_t b) {
+  ASSERT(a.pointer != NULL);
+  ASSERT(a.length >= b);
   ASSERT(buffer_ != NULL);
   ASSERT(location_ != NULL);
   int l = 0;
   const char * const begin = TSUrlHostGet(buffer_, url(), &l),
         * const end = begin + l;
-  return std::search(begin, end, a, a + b) != end;
+  return a.prefix(b).find(begin, end) != end;
 }
 
 bool TSImplementation::EqualDomain(
@@ -248,28 +324,28 @@ bool TSImplementation::EqualDomain(
 }
 
 bool TSImplementation::StartsWithDomain(
-    const char * const a, const uint32_t b, const uint32_t c) {
-  ASSERT(a != NULL);
-  ASSERT(strlen(a) >= b);
+    const Needle & a, const uint32_t b, const uint32_t c) {
+  ASSERT(a.pointer != NULL);
+  ASSERT(a.length >= b);
   ASSERT(buffer_ != NULL);
   ASSERT(location_ != NULL);
   int l = 0;
   const char * const begin = TSUrlHostGet(buffer_, url(), &l),
         * const end = begin + l;
   return begin != end
-    && std::search(begin, end, a, a + b) == begin + c;
+    && a.prefix(b).find(begin, end) == begin + c;
 }
 
 bool TSImplementation::ContainsPath(
-    const char * const a, const uint32_t b) {
-  ASSERT(a != NULL);
-  ASSERT(strlen(a) >= b);
+    const Needle & a, const uint32_t b) {
+  ASSERT(a.pointer != NULL);
+  ASSERT(a.length >= b);
   ASSERT(buffer_ != NULL);
   ASSERT(location_ != NULL);
   int l = 0;
   const char * const begin = TSUrlPathGet(buffer_, url(), &l),
         * const end = begin + l;
-  return std::search(begin, end, a, a + b) != end;
+  return a.prefix(b).find(begin, end) != end;
 }
 
 bool TSImplementation::EqualPath(
@@ -284,85 +360,85 @@ bool TSImplementation::EqualPath(
 }
 
 bool TSImplementation::StartsWithPath(
-    const char * const a, const uint32_t b, const uint32_t c) {
-  ASSERT(a != NULL);
-  ASSERT(strlen(a) >= b);
+    const Needle & a, const uint32_t b, const uint32_t c) {
+  ASSERT(a.pointer != NULL);
+  ASSERT(a.length >= b);
   ASSERT(buffer_ != NULL);
   ASSERT(location_ != NULL);
   int l = 0;
   const char * const begin = TSUrlPathGet(buffer_, url(), &l),
         * const end = begin + l;
   return begin != end
-    && std::search(begin, end, a, a + b) == begin + c;
+    && a.prefix(b).find(begin, end) == begin + c;
 }
 
 bool TSImplementation::ContainsQueryParameter(
-    const char * const a, const char * const b) {
-  return Loop< QueryParameters >(queryParameters()[a], Contains(b, strlen(b)));
+    const util::StringView & a, const Needle & b) {
+  return Loop< QueryParameters >(queryParameters()[a], Contains(b));
 }
 
 bool TSImplementation::EqualQueryParameter(
-    const char * const a, const char * const b) {
-  return Loop< QueryParameters >(queryParameters()[a], Equal(b, strlen(b)));
+    const util::StringView & a, const util::StringView & b) {
+  return Loop< QueryParameters >(queryParameters()[a], Equal(b.pointer, b.length));
 }
 
 bool TSImplementation::GreaterThanQueryParameter(
-    const char * const a, const int64_t b) {
+    const util::StringView & a, const int64_t b) {
   return Loop< QueryParameters >(queryParameters()[a], GreaterThan< int64_t >(b));
 }
 
-bool TSImplementation::GreaterThanAfterQueryParameter(const char * const a,
-    const char * const b, const int64_t c) {
+bool TSImplementation::GreaterThanAfterQueryParameter(const util::StringView & a,
+    const Needle & b, const int64_t c) {
   return Loop< QueryParameters >(queryParameters()[a],
-      GreaterThanAfter< int64_t >(b, strlen(b), c));
+      GreaterThanAfter< int64_t >(b, c));
 }
 
 bool TSImplementation::LessThanQueryParameter(
-    const char * const a, const int64_t b) {
+    const util::StringView & a, const int64_t b) {
   return Loop< QueryParameters >(queryParameters()[a], LessThan< int64_t >(b));
 }
 
-bool TSImplementation::LessThanAfterQueryParameter(const char * const a,
-    const char * const b, const int64_t c) {
+bool TSImplementation::LessThanAfterQueryParameter(const util::StringView & a,
+    const Needle & b, const int64_t c) {
   return Loop< QueryParameters >(queryParameters()[a],
-      LessThanAfter< int64_t >(b, strlen(b), c));
+      LessThanAfter< int64_t >(b, c));
 }
 
 bool TSImplementation::StartsWithQueryParameter(
-    const char * const a, const char * const b, const uint32_t c) {
-  return Loop< QueryParameters >(queryParameters()[a], StartsWith(b, strlen(b), c));
+    const util::StringView & a, const Needle & b, const uint32_t c) {
+  return Loop< QueryParameters >(queryParameters()[a], StartsWith(b, c));
 }
 
 bool TSImplementation::ContainsCookie(
-    const char * const a, const char * const b) {
-  return Loop< Cookies >(cookies()[a], Contains(b, strlen(b)));
+    const util::StringView & a, const Needle & b) {
+  return Loop< Cookies >(cookies()[a], Contains(b));
 }
 
 bool TSImplementation::EqualCookie(
-    const char * const a, const char * const b) {
-  return Loop< Cookies >(cookies()[a], Equal(b, strlen(b)));
+    const util::StringView & a, const util::StringView & b) {
+  return Loop< Cookies >(cookies()[a], Equal(b.pointer, b.length));
 }
 
 bool TSImplementation::GreaterThanCookie(
-    const char * const a, const int64_t b) {
+    const util::StringView & a, const int64_t b) {
   return Loop< Cookies >(cookies()[a], GreaterThan< int64_t >(b));
 }
 
-bool TSImplementation::GreaterThanAfterCookie(const char * const a,
-    const char * const b, const int64_t c) {
+bool TSImplementation::GreaterThanAfterCookie(const util::StringView & a,
+    const Needle & b, const int64_t c) {
   return Loop< Cookies >(cookies()[a],
-      GreaterThanAfter< int64_t >(b, strlen(b), c));
+      GreaterThanAfter< int64_t >(b, c));
 }
 
 bool TSImplementation::LessThanCookie(
-    const char * const a, const int64_t b) {
+    const util::StringView & a, const int64_t b) {
   return Loop< Cookies >(cookies()[a], LessThan< int64_t >(b));
 }
 
-bool TSImplementation::LessThanAfterCookie(const char * const a,
-    const char * const b, const int64_t c) {
+bool TSImplementation::LessThanAfterCookie(const util::StringView & a,
+    const Needle & b, const int64_t c) {
   return Loop< Cookies >(cookies()[a],
-      LessThanAfter< int64_t >(b, strlen(b), c));
+      LessThanAfter< int64_t >(b, c));
 }
 } //end of filters namespace
 } //end of http namespace
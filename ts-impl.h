@@ -13,6 +13,7 @@
 #include <ts/ts.h>
 
 #include "base-impl.h"
+#include "needle.h"
 #include "string-view.h"
 #include "ts.h"
 
@@ -20,35 +21,43 @@ namespace http {
 namespace filters {
 
 struct TSImplementation : BaseImplementation {
-  std::string tag_;
+  const char * tag_;
   TSMBuffer buffer_;
   TSMLoc location_;
   TSMLoc url_;
   Headers headers_;
   QueryParameters queryParameters_;
   Cookies cookies_;
+  //the maps above hold all they will, see Prefetch.
+  bool fetched_;
 
   ~TSImplementation() {
+    clear();
+  }
+
+  TSImplementation(const char * const t, const TSMBuffer & b, const TSMLoc & l) :
+    tag_(t), buffer_(b), location_(l), url_(NULL), fetched_(false) { }
+
+  //releases the url handle, must happen before the request is released.
+  inline void clear(void) {
     ASSERT(buffer_ != NULL);
     ASSERT(location_ != NULL);
     if (url_ != NULL) {
       TSHandleMLocRelease(buffer_, location_, url_);
+      url_ = NULL;
     }
   }
 
-  TSImplementation(const char * const t, const TSMBuffer & b, const TSMLoc & l) :
-    tag_(t), buffer_(b), location_(l), url_(NULL) { }
-
   inline Headers & headers(void) {
-    if (headers_.empty()) {
+    if (headers_.empty() && ! fetched_) {
       headers_ = Headers(buffer_, location_);
     }
     return headers_;
   }
 
   inline Cookies & cookies(void) {
-    if (cookies_.empty()) {
-      Headers::Result r = headers()["Cookie"];
+    if (cookies_.empty() && ! fetched_) {
+      Headers::Result r = headers()["cookie"];
       if (r.second && ! r.first->empty()) {
         cookies_ = Cookies((*r.first)[0]);
       }
@@ -57,19 +66,21 @@ struct TSImplementation : BaseImplementation {
   }
 
   inline QueryParameters & queryParameters(void) {
-    if (queryParameters_.empty()) {
+    if (queryParameters_.empty() && ! fetched_) {
       queryParameters_ = QueryParameters(queryParameter(buffer_));
     }
     return queryParameters_;
   }
 
+  bool Prefetch(const Requirements &, Requirements::Mask &);
+
   bool PrintError(const char * const c, const char * const l) const {
-    TSError("[%s] %s\n", strlen(l) > 0 ? l : tag_.c_str(), c);
+    TSError("[%s] %s\n", strlen(l) > 0 ? l : tag_, c);
     return true;
   }
 
   bool PrintDebug(const char * const c, const char * const l) const {
-    TSDebug(strlen(l) > 0 ? l : tag_.c_str(), "%s", c);
+    TSDebug(strlen(l) > 0 ? l : tag_, "%s", c);
     return true;
   }
 
@@ -85,23 +96,23 @@ struct TSImplementation : BaseImplementation {
 
   bool IsScheme(const char * const, const uint32_t);
 
-  bool ContainsDomain(const char * const, const uint32_t);
+  bool ContainsDomain(const Needle &, const uint32_t);
   bool EqualDomain(const char * const, const uint32_t);
 
   inline bool NotEqualDomain(const char * const a, const uint32_t b) {
     return ! EqualDomain(a, b);
   }
 
-  bool StartsWithDomain(const char * const, const uint32_t, const uint32_t);
+  bool StartsWithDomain(const Needle &, const uint32_t, const uint32_t);
 
-  bool ContainsPath(const char * const, const uint32_t);
+  bool ContainsPath(const Needle &, const uint32_t);
   bool EqualPath(const char * const, const uint32_t);
 
   inline bool NotEqualPath(const char * const a, const uint32_t b) {
     return ! EqualPath(a, b);
   }
 
-  bool StartsWithPath(const char * const, const uint32_t, const uint32_t);
+  bool StartsWithPath(const Needle &, const uint32_t, const uint32_t);
 
   util::StringView queryParameter(const TSMBuffer & b) {
     int length = 0;
@@ -109,58 +120,130 @@ struct TSImplementation : BaseImplementation {
     return util::StringView(pointer, length);
   }
 
-  bool ContainsQueryParameter(const char * const, const char * const);
-  bool EqualQueryParameter(const char * const, const char * const);
+  bool ContainsQueryParameter(const util::StringView &, const Needle &);
+  bool EqualQueryParameter(const util::StringView &, const util::StringView &);
 
-  inline bool ExistsQueryParameter(const char * const a) {
+  inline bool ExistsQueryParameter(const util::StringView & a) {
     return queryParameters()[a].second;
   }
 
-  bool GreaterThanQueryParameter(const char * const, const int64_t);
-  bool GreaterThanAfterQueryParameter(const char * const, const char * const, const int64_t);
-  bool LessThanQueryParameter(const char * const, const int64_t);
-  bool LessThanAfterQueryParameter(const char * const, const char * const, const int64_t);
+  bool GreaterThanQueryParameter(const util::StringView &, const int64_t);
+  bool GreaterThanAfterQueryParameter(const util::StringView &, const Needle &, const int64_t);
+  bool LessThanQueryParameter(const util::StringView &, const int64_t);
+  bool LessThanAfterQueryParameter(const util::StringView &, const Needle &, const int64_t);
 
-  inline bool NotEqualQueryParameter(const char * const a, const char * const b) {
+  inline bool NotEqualQueryParameter(const util::StringView & a,
+      const util::StringView & b) {
     return ExistsQueryParameter(a) && ! EqualQueryParameter(a, b);
   }
 
-  bool StartsWithQueryParameter(const char * const, const char * const, const uint32_t);
+  bool StartsWithQueryParameter(const util::StringView &, const Needle &, const uint32_t);
 
-  bool ContainsHeader(const char * const, const char * const);
-  bool EqualHeader(const char * const, const char * const);
+  bool ContainsHeader(const util::StringView &, const Needle &);
+  bool EqualHeader(const util::StringView &, const util::StringView &);
 
-  inline bool ExistsHeader(const char * const a) {
+  inline bool ExistsHeader(const util::StringView & a) {
     return headers()[a].second;
   }
 
-  bool GreaterThanHeader(const char * const, const int64_t);
-  bool GreaterThanAfterHeader(const char * const, const char * const, const int64_t);
-  bool LessThanHeader(const char * const, const int64_t);
-  bool LessThanAfterHeader(const char * const, const char * const, const int64_t);
+  bool GreaterThanHeader(const util::StringView &, const int64_t);
+  bool GreaterThanAfterHeader(const util::StringView &, const Needle &, const int64_t);
+  bool LessThanHeader(const util::StringView &, const int64_t);
+  bool LessThanAfterHeader(const util::StringView &, const Needle &, const int64_t);
 
-  inline bool NotEqualHeader(const char * const a, const char * const b) {
+  inline bool NotEqualHeader(const util::StringView & a,
+      const util::StringView & b) {
     return ExistsHeader(a) && ! EqualHeader(a, b);
   }
 
-  bool StartsWithHeader(const char * const, const char * const, const uint32_t);
+  bool StartsWithHeader(const util::StringView &, const Needle &, const uint32_t);
+
+  bool ContainsHeaderI(const util::StringView &, const Needle &);
+  bool EqualHeaderI(const util::StringView &, const util::StringView &);
 
-  bool ContainsCookie(const char * const, const char * const);
-  bool EqualCookie(const char * const, const char * const);
+  inline bool NotEqualHeaderI(const util::StringView & a,
+      const util::StringView & b) {
+    return ExistsHeader(a) && ! EqualHeaderI(a, b);
+  }
+
+  bool ContainsCookie(const util::StringView &, const Needle &);
+  bool EqualCookie(const util::StringView &, const util::StringView &);
 
-  inline bool ExistsCookie(const char * const a) {
+  inline bool ExistsCookie(const util::StringView & a) {
     return cookies()[a].second;
   }
 
-  bool GreaterThanCookie(const char * const, const int64_t);
-  bool GreaterThanAfterCookie(const char * const, const char * const, const int64_t);
-  bool LessThanCookie(const char * const, const int64_t);
-  bool LessThanAfterCookie(const char * const, const char * const, const int64_t);
+  bool GreaterThanCookie(const util::StringView &, const int64_t);
+  bool GreaterThanAfterCookie(const util::StringView &, const Needle &, const int64_t);
+  bool LessThanCookie(const util::StringView &, const int64_t);
+  bool LessThanAfterCookie(const util::StringView &, const Needle &, const int64_t);
 
-  inline bool NotEqualCookie(const char * const a, const char * const b) {
+  inline bool NotEqualCookie(const util::StringView & a,
+      const util::StringView & b) {
     return ExistsCookie(a) && ! EqualCookie(a, b);
   }
 
+  //a missing name is a scan that found nothing.
+  template < class T, class F >
+  static bool Scan(const typename T::Result & r, const Automaton & a, F & f) {
+    if (r.second) {
+      ASSERT(r.first != NULL);
+      typedef typename T::Values::const_iterator Iterator;
+      const Iterator end = r.first->end();
+      for (Iterator it = r.first->begin(); it != end; ++it) {
+        a.scan(it->pointer, it->length, f);
+      }
+    }
+    return true;
+  }
+
+  template < class F >
+  bool ContainsManyDomain(const Automaton & a, F & f) {
+    int l = 0;
+    const char * const p = TSUrlHostGet(buffer_, url(), &l);
+    a.scan(p, l, f);
+    return true;
+  }
+
+  template < class F >
+  bool ContainsManyPath(const Automaton & a, F & f) {
+    int l = 0;
+    const char * const p = TSUrlPathGet(buffer_, url(), &l);
+    a.scan(p, l, f);
+    return true;
+  }
+
+  bool EqualDomainSet(const HashSet & s, bool & r) {
+    int l = 0;
+    const char * const p = TSUrlHostGet(buffer_, url(), &l);
+    r = s.find(p, l);
+    return true;
+  }
+
+  bool EqualPathSet(const HashSet & s, bool & r) {
+    int l = 0;
+    const char * const p = TSUrlPathGet(buffer_, url(), &l);
+    r = s.find(p, l);
+    return true;
+  }
+
+  template < class F >
+  bool ContainsManyQueryParameter(const util::StringView & n,
+      const Automaton & a, F & f) {
+    return Scan< QueryParameters >(queryParameters()[n], a, f);
+  }
+
+  template < class F >
+  bool ContainsManyHeader(const util::StringView & n, const Automaton & a,
+      F & f) {
+    return Scan< Headers >(headers()[n], a, f);
+  }
+
+  template < class F >
+  bool ContainsManyCookie(const util::StringView & n, const Automaton & a,
+      F & f) {
+    return Scan< Cookies >(cookies()[n], a, f);
+  }
 };
 } //end of filters namespace
 } //end of http namespace
@@ -27,14 +27,24 @@ util::StringView getHeader(const TSMBuffer b, const TSMLoc l, const char * const
   return result;
 }
 
-Headers::Headers(const TSMBuffer & b, const TSMLoc & l) {
+Headers::Headers(const TSMBuffer & b, const TSMLoc & l,
+    const Requirements * const r) {
+  std::string name;
   TSMLoc location = TSMimeHdrFieldGet(b, l, 0);
   while (location != 0) {
     int length = 0;
     const char * const buffer = TSMimeHdrFieldNameGet(b, l, location, &length);
     ASSERT(buffer != NULL);
-    if (buffer != NULL && length > 0) {
-      Values & v = map_[util::StringView(buffer, length)];
+    if (buffer != NULL && length > 0 && (r == NULL
+          || r->wants(Requirements::kHeaders, buffer, length))) {
+      util::Fold(buffer, length, name);
+      Map::iterator it = map_.find(util::StringView(name.data(), length));
+      if (it == map_.end()) {
+        names_.push_back(name);
+        it = map_.insert(std::make_pair(
+              util::StringView(names_.back().data(), length), Values())).first;
+      }
+      Values & v = it->second;
       int length2 = 0;
       const char * const buffer2 = TSMimeHdrFieldValueStringGet(b, l, location, -1, &length2);
       ASSERT(buffer != NULL);
@@ -51,10 +61,28 @@ Headers::Headers(const TSMBuffer & b, const TSMLoc & l) {
   }
 }
 
+Headers::Headers(const Headers & h) {
+  *this = h;
+}
+
+//the keys point into names_, they are made again for the copy.
+Headers & Headers::operator = (const Headers & h) {
+  if (this != &h) {
+    map_.clear();
+    names_.clear();
+    const Map::const_iterator end = h.map_.end();
+    for (Map::const_iterator it = h.map_.begin(); it != end; ++it) {
+      names_.push_back(it->first.str());
+      map_.insert(std::make_pair(util::StringView(names_.back().data(),
+              it->first.length), it->second));
+    }
+  }
+  return *this;
+}
+
 Headers::Result Headers::operator [] (
-    const char * const a) const {
-  const Map::const_iterator it = map_.find(
-      util::StringView(a, strlen(a)));
+    const util::StringView & a) const {
+  const Map::const_iterator it = map_.find(a);
   if (it != map_.end()) {
     return Result(&(it->second), true);
   }
@@ -79,7 +107,8 @@ void Headers::print(std::ostream & o) const {
 }
 
 
-Cookies::Cookies(const util::StringView & s) {
+Cookies::Cookies(const util::StringView & s, const Requirements * const r) :
+  wanted_(r) {
   if (s.pointer != NULL) {
     ASSERT(s.length > 0);
     parse(s);
@@ -109,29 +138,34 @@ void Cookies::parse(const util::StringView & s) {
       }
       break;
     case ';':
-      map_[util::StringView(i, j - i)]
-        .push_back(util::StringView(j + 1, k - j - 1));
+      insert(util::StringView(i, j - i), util::StringView(j + 1, k - j - 1));
       skipSpaces = true;
       break;
     }
   }
   if (i < j) {
-    map_[util::StringView(i, j - i)]
-      .push_back(util::StringView(j + 1, k - j - 1));
+    insert(util::StringView(i, j - i), util::StringView(j + 1, k - j - 1));
+  }
+}
+
+void Cookies::insert(const util::StringView & n, const util::StringView & v) {
+  if (wanted_ == NULL
+      || wanted_->wants(Requirements::kCookies, n.pointer, n.length)) {
+    map_[n].push_back(v);
   }
 }
 
 Cookies::Result Cookies::operator [] (
-    const char * const a) const {
-  const Map::const_iterator it = map_.find(
-      util::StringView(a, strlen(a)));
+    const util::StringView & a) const {
+  const Map::const_iterator it = map_.find(a);
   if (it != map_.end()) {
     return Result(&(it->second), true);
   }
   return Result(NULL, false);
 }
 
-QueryParameters::QueryParameters(const util::StringView & s) {
+QueryParameters::QueryParameters(const util::StringView & s,
+    const Requirements * const r) : wanted_(r) {
   if (s.pointer != NULL) {
     ASSERT(s.length > 0);
     parse(s);
@@ -146,6 +180,10 @@ void QueryParameters::push(const char * const i,
   if (j <= i) {
     j = k;
   }
+  if (wanted_ != NULL
+      && ! wanted_->wants(Requirements::kParameters, i, j - i)) {
+    return;
+  }
   Values & v = map_[util::StringView(i, j - i)];
   if (j + 1 <= k) {
     v.push_back(util::StringView(j + 1, k - j - 1));
@@ -175,9 +213,8 @@ void QueryParameters::parse(const util::StringView & s) {
 }
 
 QueryParameters::Result QueryParameters::operator [] (
-    const char * const a) const {
-  const Map::const_iterator it = map_.find(
-      util::StringView(a, strlen(a)));
+    const util::StringView & a) const {
+  const Map::const_iterator it = map_.find(a);
   if (it != map_.end()) {
     return Result(&(it->second), true);
   }
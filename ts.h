@@ -7,6 +7,7 @@
 #ifndef TS_H
 #define TS_H
 
+#include <deque>
 #include <map>
 #include <ostream>
 #include <string>
@@ -16,6 +17,8 @@
 
 #include <ts/ts.h>
 
+#include "fold.h"
+#include "requirements.h"
 #include "string-view.h"
 
 namespace http {
@@ -23,17 +26,27 @@ namespace filters {
 
 util::StringView getHeader(const TSMBuffer, const TSMLoc, const char * const);
 
+/*
+ * field names are case insensitive, the keys are the names folded once,
+ * looked up by names folded already.
+ */
 struct Headers {
   typedef std::vector< util::StringView > Values;
   typedef std::map< util::StringView, Values, util::StringViewLess > Map;
   typedef std::pair< const Values *, bool > Result;
 
   Map map_;
+  //the folded names the keys point into, a deque does not move them.
+  std::deque< std::string > names_;
 
   Headers(void) { }
-  Headers(const TSMBuffer &, const TSMLoc &);
+  //given Requirements, only the headers they want.
+  Headers(const TSMBuffer &, const TSMLoc &,
+      const Requirements * const r = NULL);
+  Headers(const Headers &);
+  Headers & operator = (const Headers &);
   inline bool empty(void) const { return map_.empty(); }
-  Result operator [] (const char * const) const;
+  Result operator [] (const util::StringView &) const;
   void print(std::ostream &) const;
 };
 
@@ -44,11 +57,14 @@ struct Cookies {
 
   Map map_;
 
-  Cookies(void) { }
-  Cookies(const util::StringView &);
+  const Requirements * wanted_;
+
+  Cookies(void) : wanted_(NULL) { }
+  Cookies(const util::StringView &, const Requirements * const r = NULL);
   void parse(const util::StringView &);
+  void insert(const util::StringView &, const util::StringView &);
   inline bool empty(void) const { return map_.empty(); }
-  Result operator [] (const char * const) const;
+  Result operator [] (const util::StringView &) const;
   void push(const char * const, const char * &, const char * const);
 };
 
@@ -59,11 +75,14 @@ struct QueryParameters {
 
   Map map_;
 
-  QueryParameters(void) { }
-  QueryParameters(const util::StringView &);
+  const Requirements * wanted_;
+
+  QueryParameters(void) : wanted_(NULL) { }
+  QueryParameters(const util::StringView &,
+      const Requirements * const r = NULL);
   void parse(const util::StringView &);
   inline bool empty(void) const { return map_.empty(); }
-  Result operator [] (const char * const) const;
+  Result operator [] (const util::StringView &) const;
   void push(const char * const, const char * &, const char * const);
 };
 
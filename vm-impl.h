@@ -11,98 +11,134 @@
 
 #include "vm.h"
 
-#define P_A m_ + registers_.a
-#define P_B m_ + registers_.b
+#define OPERATION (*registers_.operation)
+#define P_A (memory_ + OPERATION.a)
+#define P_B (memory_ + OPERATION.b)
 #define P_AB P_A, P_B
 #define P_BA P_B, P_A
+#define N_A Needle::In(P_A, OPERATION.la)
+#define N_B Needle::In(P_B, OPERATION.lb)
+#define S_A util::StringView(P_A, OPERATION.la)
+#define S_B util::StringView(P_B, OPERATION.lb)
+
+#ifdef USE_COMPUTED_GOTO
+#define OPCODE(O) O
+#define NEXT { \
+  next(); \
+  ASSERT(OPERATION.op < Opcodes::kUpperBound); \
+  goto * labels[OPERATION.op]; \
+}
+#else
+#define OPCODE(O) case Opcodes::O
+#define NEXT return true
+#endif
 
 namespace http {
 namespace filters {
 
 template < class I >
 bool VM< I >::run(const uint32_t o, const uint32_t j) {
-  ASSERT(o < c_.size);
-  ASSERT(j < c_.size - o);
-  jumpBit(o);
+  ASSERT(o < p_.size());
+  ASSERT(j < p_.size() - o);
   registers_.pc = o;
   registers_.count = j > 0 ? j : -1;
 
-  while (true) {
-    ASSERT(registers_.mode > ExecutionMode::kNull);
-    ASSERT(registers_.mode < ExecutionMode::kUpperBound);
-
-    //checks previous operation
+  do {
+    next();
+  } while (dispatch());
 
-    if (registers_.count == 0) {
-      forceReturn();
+  return result();
+}
 
-    } else if (registers_.mode == ExecutionMode::kNone
-      || (registers_.mode == ExecutionMode::kAnd && registers_.r)
-      || (registers_.mode == ExecutionMode::kOr && ! registers_.r)) {
+template < class I >
+void VM< I >::runAll(const Offsets & o, Bitmap & b) {
+  ASSERT(o.size() <= static_cast< size_t >(b.size()));
+  Bit r = b.begin();
+  const Offsets::const_iterator end = o.end();
+  for (Offsets::const_iterator it = o.begin(); it != end; ++it, ++r) {
+    r = implied(*it) ? result() : run(*it);
+  }
+}
 
-      //checks the cache.
-      if (static_cast< bool >(bit_)) {
-        incrementBit();
-        result(static_cast< bool >(bit_));
-        step();
-        incrementBit();
-        continue;
-      } else {
-        fetch();
-      }
+template < class I >
+void VM< I >::runAll(const Offsets & o, Bitmap & b, const Requirements & q) {
+  ASSERT(o.size() <= static_cast< size_t >(b.size()));
+  ASSERT(o.size() == q.needs_.size());
+  Requirements::Mask present = 0;
+  if ( ! i_.Prefetch(q, present)) {
+    runAll(o, b);
+    return;
+  }
+  Bit r = b.begin();
+  for (uint32_t i = 0; i < o.size(); ++i, ++r) {
+    if (q.skips(i, present)) {
+      r = false;
     } else {
-      forceReturn();
-    }
-
-    dispatch();
-
-    if (registers_.op == Opcodes::kReturn) {
-      if ( ! stack_.empty()) {
-        const bool r = registers_.r;
-        stackPop();
-        result(r);
-
-        ASSERT(registers_.pc > 0);
-        ASSERT(registers_.pc < c_.size);
-
-        const uint32_t previous = registers_.pc - 1;
-        jumpBit(previous);
-        const uint32_t * b = c_ + previous * kSize;
-        if (b[0] == Opcodes::kExecute
-            && (b[1] == ExecutionMode::kOr
-            || ExecutionMode::kAnd)) {
-          bit_ = true;
-          incrementBit();
-          bit_ = r;
-        } else {
-          incrementBit();
-        }
-        incrementBit();
-      } else {
-        //TODO(dmorilha): investigate if this is a semantic fault.
-        break;
-      }
-    } else if (registers_.op == Opcodes::kHalt) {
-      break;
+      r = implied(o[i]) ? result() : run(o[i]);
     }
   }
+}
 
-  return result();
+template < class I >
+void VM< I >::runDiagram(const uint32_t o, Bitmap & b) {
+  matches_ = NULL;
+  run(o);
+  ASSERT(matches_ != NULL);
+  b.reset();
+  for (uint32_t i = 1; i <= matches_[0]; ++i) {
+    ASSERT(matches_[i] < static_cast< uint32_t >(b.size()));
+    b[matches_[i]] = true;
+  }
 }
 
 template < class I >
-void VM< I >::dispatch(void) {
-  bool cache = false,
-       r;
-  //TODO(dmorilha): investigate the use of computed gotos.
-  //http://eli.thegreenplace.net/2012/07/12/computed-goto-for-efficient-dispatch-tables
-  switch (registers_.op) {
-  case Opcodes::kNull: ASSERT(false); break;//unrecheable
-  case Opcodes::kSkip: break;
-
-  case Opcodes::kExecute:
+bool VM< I >::dispatch(void) {
+#ifdef USE_COMPUTED_GOTO
+  static const void * const labels[] = {
+    &&kNull, &&kSkip, &&kExecute, &&kExecuteSingle, &&kReturn, &&kHalt,
+    &&kNone, &&kAnd, &&kOr, &&kNot, &&kFlip, &&kFalse, &&kTrue,
+    &&kPrintError, &&kPrintDebug,
+    &&kIsMethod, &&kIsScheme, &&kContainsDomain, &&kEqualDomain,
+    &&kNotEqualDomain, &&kStartsWithDomain, &&kContainsPath, &&kEqualPath,
+    &&kNotEqualPath, &&kStartsWithPath, &&kContainsQueryParameter,
+    &&kEqualQueryParameter, &&kExistsQueryParameter,
+    &&kGreaterThanQueryParameter, &&kGreaterThanAfterQueryParameter,
+    &&kLessThanQueryParameter, &&kLessThanAfterQueryParameter,
+    &&kNotEqualQueryParameter, &&kStartsWithQueryParameter, &&kContainsHeader,
+    &&kEqualHeader, &&kExistsHeader, &&kGreaterThanHeader,
+    &&kGreaterThanAfterHeader, &&kLessThanHeader, &&kLessThanAfterHeader,
+    &&kNotEqualHeader, &&kStartsWithHeader, &&kContainsCookie, &&kEqualCookie,
+    &&kExistsCookie, &&kGreaterThanCookie, &&kGreaterThanAfterCookie,
+    &&kLessThanCookie, &&kLessThanAfterCookie, &&kNotEqualCookie,
+    &&kExistsContainsQueryParameter, &&kExistsEqualQueryParameter,
+    &&kExistsGreaterThanQueryParameter, &&kExistsLessThanQueryParameter,
+    &&kExistsStartsWithQueryParameter, &&kExistsContainsHeader,
+    &&kExistsEqualHeader, &&kExistsGreaterThanHeader, &&kExistsLessThanHeader,
+    &&kExistsStartsWithHeader, &&kExistsContainsCookie, &&kExistsEqualCookie,
+    &&kExistsGreaterThanCookie, &&kExistsLessThanCookie,
+    &&kJump, &&kJumpIfTrue, &&kJumpIfFalse,
+    &&kContainsManyDomain, &&kContainsManyPath, &&kContainsManyQueryParameter,
+    &&kContainsManyHeader, &&kContainsManyCookie,
+    &&kEqualDomainSet, &&kEqualPathSet, &&kMatches,
+    &&kContainsHeaderI, &&kEqualHeaderI, &&kNotEqualHeaderI,
+  };
+
+  ASSERT(ARRAY_SIZE(labels) == Opcodes::kUpperBound);
+  ASSERT(OPERATION.op < Opcodes::kUpperBound);
+  goto * labels[OPERATION.op];
+#else
+  switch (OPERATION.op) {
+#endif
+  OPCODE(kNull): ASSERT(false); return false; //unrecheable
+  OPCODE(kExecuteSingle): ASSERT(false); return false; //resolved by fetch
+
+  OPCODE(kSkip):
+    NEXT;
+
+  OPCODE(kExecute):
     {
-      const Registers & p = stackPush();
+      const Operation & p = OPERATION;
+      stackPush();
 
       switch (p.a) {
       case ExecutionMode::kNull: ASSERT(false); break; //unrecheable
@@ -126,280 +162,430 @@ void VM< I >::dispatch(void) {
       }
 
       registers_.pc = p.b;
-      ASSERT(registers_.pc < c_.size);
+      ASSERT(registers_.pc < p_.size());
       registers_.count = p.c > 0 ? p.c : -1;
-      jumpBit(registers_.pc);
 
       /*
       std::cerr << "EXECUTE " << (int)registers_.mode << " " << registers_.pc
         << " " << registers_.count << "\n";
       */
-      return;
     }
+    NEXT;
 
-    break;
+  OPCODE(kReturn): //go back one level in the stack.
+    if ( ! unwind()) {
+      return false;
+    }
+    NEXT;
+
+  OPCODE(kHalt): return false; //stop execution.
+
+  OPCODE(kJump):
+    registers_.pc = OPERATION.a;
+    NEXT;
 
-  case Opcodes::kReturn: break; //go back one level in the stack.
-  case Opcodes::kHalt: break; //stop execution.
+  OPCODE(kJumpIfTrue):
+    if (registers_.r) {
+      registers_.pc = OPERATION.a;
+    }
+    NEXT;
+
+  OPCODE(kJumpIfFalse):
+    if ( ! registers_.r) {
+      registers_.pc = OPERATION.a;
+    }
+    NEXT;
 
-  case Opcodes::kNone:
+  OPCODE(kNone):
     //std::cerr << "NONE" "\n";
     registers_.mode = ExecutionMode::kNone;
-    break;
+    NEXT;
 
-  case Opcodes::kAnd:
+  OPCODE(kAnd):
     //std::cerr << "AND" "\n";
     registers_.mode = ExecutionMode::kAnd;
-    registers_.r = r = true;
-    break;
+    registers_.r = true;
+    NEXT;
 
-  case Opcodes::kOr:
+  OPCODE(kOr):
     //std::cerr << "OR" "\n";
     registers_.mode = ExecutionMode::kOr;
     registers_.r = false;
-    break;
+    NEXT;
 
-  case Opcodes::kNot:
+  OPCODE(kNot):
     //std::cerr << "NOT" "\n";
     registers_.n = true;
-    break;
+    NEXT;
 
-  case Opcodes::kFlip:
+  OPCODE(kFlip):
     //std::cerr << "FLIP" "\n";
-    result( r = ( ! result()));
-    cache = true;
-    break;
+    memo( ! result());
+    NEXT;
 
-  case Opcodes::kTrue:
+  OPCODE(kTrue):
     //std::cerr << "TRUE" "\n";
-    result(r = true);
-    cache = true;
-    break;
+    memo(true);
+    NEXT;
 
-  case Opcodes::kFalse:
+  OPCODE(kFalse):
     //std::cerr << "FALSE" "\n";
-    result(r = false);
-    cache = true;
-    break;
-
-  case Opcodes::kPrintError:
-    ASSERT(registers_.c < ExecutionMode::kUpperBound);
-    if ( ! ((registers_.c == ExecutionMode::kAnd && ! registers_.r)
-      || (registers_.c == ExecutionMode::kOr && registers_.r))) {
+    memo(false);
+    NEXT;
+
+  OPCODE(kPrintError):
+    ASSERT(OPERATION.c < ExecutionMode::kUpperBound);
+    if ( ! ((OPERATION.c == ExecutionMode::kAnd && ! registers_.r)
+      || (OPERATION.c == ExecutionMode::kOr && registers_.r))) {
       i_.PrintError(P_AB);
     }
-    break;
+    NEXT;
 
-  case Opcodes::kPrintDebug:
-    ASSERT(registers_.c < ExecutionMode::kUpperBound);
-    if ( ! ((registers_.c == ExecutionMode::kAnd && ! registers_.r)
-      || (registers_.c == ExecutionMode::kOr && registers_.r))) {
+  OPCODE(kPrintDebug):
+    ASSERT(OPERATION.c < ExecutionMode::kUpperBound);
+    if ( ! ((OPERATION.c == ExecutionMode::kAnd && ! registers_.r)
+      || (OPERATION.c == ExecutionMode::kOr && registers_.r))) {
       i_.PrintDebug(P_AB);
     }
-    break;
-
-  case Opcodes::kIsMethod:
-    result(r = i_.IsMethod(P_A, registers_.b));
-    cache = true;
-    break;
-
-  case Opcodes::kIsScheme:
-    result(r = i_.IsScheme(P_A, registers_.b));
-    cache = true;
-    break;
-
-  case Opcodes::kContainsDomain:
-    result(r = i_.ContainsDomain(P_A, registers_.b));
-    cache = true;
-    break;
-
-  case Opcodes::kEqualDomain:
-    result(r = i_.EqualDomain(P_A, registers_.b));
-    cache = true;
-    break;
-
-  case Opcodes::kNotEqualDomain:
-    result(r = i_.NotEqualDomain(P_A, registers_.b));
-    cache = true;
-    break;
-
-  case Opcodes::kStartsWithDomain:
-    result(r = i_.StartsWithDomain(P_A, registers_.b, registers_.c));
-    cache = true;
-    break;
-
-  case Opcodes::kContainsPath:
-    result(r = i_.ContainsPath(P_A, registers_.b));
-    cache = true;
-    break;
-
-  case Opcodes::kEqualPath:
-    result(r = i_.EqualPath(P_A, registers_.b));
-    cache = true;
-    break;
-
-  case Opcodes::kNotEqualPath:
-    result(r = i_.NotEqualPath(P_A, registers_.b));
-    cache = true;
-    break;
-
-  case Opcodes::kStartsWithPath:
-    result(r = i_.StartsWithPath(P_A, registers_.b, registers_.c));
-    cache = true;
-    break;
-
-  case Opcodes::kContainsQueryParameter:
-    result(r = i_.ContainsQueryParameter(P_AB));
-    cache = true;
-    break;
-
-  case Opcodes::kEqualQueryParameter:
-    result(r = i_.EqualQueryParameter(P_AB));
-    cache = true;
-    break;
-
-  case Opcodes::kExistsQueryParameter:
-    result(r = i_.ExistsQueryParameter(P_A));
-    cache = true;
-    break;
-
-  case Opcodes::kGreaterThanQueryParameter:
-    result(r = i_.GreaterThanQueryParameter(P_A, registers_.b));
-    cache = true;
-    break;
-
-  case Opcodes::kGreaterThanAfterQueryParameter:
-    result(r = i_.GreaterThanAfterQueryParameter(P_AB, registers_.c));
-    cache = true;
-    break;
-
-  case Opcodes::kLessThanQueryParameter:
-    result(r = i_.LessThanQueryParameter(P_A, registers_.b));
-    cache = true;
-    break;
-
-  case Opcodes::kLessThanAfterQueryParameter:
-    result(r = i_.LessThanAfterQueryParameter(P_AB, registers_.c));
-    cache = true;
-    break;
-
-  case Opcodes::kNotEqualQueryParameter:
-    result(r = i_.NotEqualQueryParameter(P_AB));
-    cache = true;
-    break;
-
-  case Opcodes::kStartsWithQueryParameter:
-    result(r = i_.StartsWithQueryParameter(P_AB, registers_.c));
-    cache = true;
-    break;
-
-  case Opcodes::kContainsHeader:
-    result(r = i_.ContainsHeader(P_AB));
-    cache = true;
-    break;
-
-  case Opcodes::kEqualHeader:
-    result(r = i_.EqualHeader(P_AB));
-    cache = true;
-    break;
-
-  case Opcodes::kExistsHeader:
-    result(r = i_.ExistsHeader(P_A));
-    cache = true;
-    break;
-
-  case Opcodes::kGreaterThanHeader:
-    result(r = i_.GreaterThanHeader(P_A, registers_.b));
-    cache = true;
-    break;
-
-  case Opcodes::kGreaterThanAfterHeader:
-    result(r = i_.GreaterThanAfterHeader(P_AB, registers_.c));
-    cache = true;
-    break;
-
-  case Opcodes::kLessThanHeader:
-    result(r = i_.LessThanHeader(P_A, registers_.b));
-    cache = true;
-    break;
-
-  case Opcodes::kLessThanAfterHeader:
-    result(r = i_.LessThanAfterHeader(P_AB, registers_.c));
-    cache = true;
-    break;
-
-  case Opcodes::kNotEqualHeader:
-    result(r = i_.NotEqualHeader(P_AB));
-    cache = true;
-    break;
-
-  case Opcodes::kStartsWithHeader:
-    result(r = i_.StartsWithHeader(P_AB, registers_.c));
-    cache = true;
-    break;
-
-  case Opcodes::kContainsCookie:
-    result(r = i_.ContainsCookie(P_AB));
-    cache = true;
-    break;
-
-  case Opcodes::kEqualCookie:
-    result(r = i_.EqualCookie(P_AB));
-    cache = true;
-    break;
-
-  case Opcodes::kExistsCookie:
-    result(r = i_.ExistsCookie(P_A));
-    cache = true;
-    break;
-
-  case Opcodes::kGreaterThanCookie:
-    result(r = i_.GreaterThanCookie(P_A, registers_.b));
-    cache = true;
-    break;
-
-  case Opcodes::kGreaterThanAfterCookie:
-    result(r = i_.GreaterThanAfterCookie(P_AB, registers_.c));
-    cache = true;
-    break;
-
-  case Opcodes::kLessThanCookie:
-    result(r = i_.LessThanCookie(P_A, registers_.b));
-    cache = true;
-    break;
-
-  case Opcodes::kLessThanAfterCookie:
-    result(r = i_.LessThanAfterCookie(P_AB, registers_.c));
-    cache = true;
-    break;
-
-  case Opcodes::kNotEqualCookie:
-    result(r = i_.NotEqualCookie(P_AB));
-    cache = true;
-    break;
-
-  case Opcodes::kUpperBound: ASSERT(false); break; //unrecheable
-  default: ASSERT(false); break; //unrecheable
-  }
+    NEXT;
 
-  if (cache) {
-    bit_ = true;
-    incrementBit();
-    bit_ = r;
-  } else {
-    incrementBit();
-  }
+  OPCODE(kIsMethod):
+    memo(i_.IsMethod(P_A, OPERATION.b));
+    NEXT;
+
+  OPCODE(kIsScheme):
+    memo(i_.IsScheme(P_A, OPERATION.b));
+    NEXT;
+
+  OPCODE(kContainsDomain):
+    memo(i_.ContainsDomain(N_A, OPERATION.b));
+    NEXT;
+
+  OPCODE(kEqualDomain):
+    memo(i_.EqualDomain(P_A, OPERATION.b));
+    NEXT;
+
+  OPCODE(kNotEqualDomain):
+    memo(i_.NotEqualDomain(P_A, OPERATION.b));
+    NEXT;
+
+  OPCODE(kStartsWithDomain):
+    memo(i_.StartsWithDomain(N_A, OPERATION.b, OPERATION.c));
+    NEXT;
+
+  OPCODE(kContainsPath):
+    memo(i_.ContainsPath(N_A, OPERATION.b));
+    NEXT;
+
+  OPCODE(kEqualPath):
+    memo(i_.EqualPath(P_A, OPERATION.b));
+    NEXT;
+
+  OPCODE(kNotEqualPath):
+    memo(i_.NotEqualPath(P_A, OPERATION.b));
+    NEXT;
+
+  OPCODE(kStartsWithPath):
+    memo(i_.StartsWithPath(N_A, OPERATION.b, OPERATION.c));
+    NEXT;
+
+  OPCODE(kContainsQueryParameter):
+    memo(i_.ContainsQueryParameter(S_A, N_B));
+    NEXT;
+
+  OPCODE(kEqualQueryParameter):
+    memo(i_.EqualQueryParameter(S_A, S_B));
+    NEXT;
+
+  OPCODE(kExistsQueryParameter):
+    memo(i_.ExistsQueryParameter(S_A));
+    NEXT;
 
-  incrementBit();
+  OPCODE(kGreaterThanQueryParameter):
+    memo(i_.GreaterThanQueryParameter(S_A, OPERATION.b));
+    NEXT;
 
-  //TODO(dmorilha) if kExecuteSingle make sure to persist into the called operation.
+  OPCODE(kGreaterThanAfterQueryParameter):
+    memo(i_.GreaterThanAfterQueryParameter(S_A, N_B, OPERATION.c));
+    NEXT;
+
+  OPCODE(kLessThanQueryParameter):
+    memo(i_.LessThanQueryParameter(S_A, OPERATION.b));
+    NEXT;
+
+  OPCODE(kLessThanAfterQueryParameter):
+    memo(i_.LessThanAfterQueryParameter(S_A, N_B, OPERATION.c));
+    NEXT;
+
+  OPCODE(kNotEqualQueryParameter):
+    memo(i_.NotEqualQueryParameter(S_A, S_B));
+    NEXT;
+
+  OPCODE(kStartsWithQueryParameter):
+    memo(i_.StartsWithQueryParameter(S_A, N_B, OPERATION.c));
+    NEXT;
+
+  OPCODE(kContainsHeader):
+    memo(i_.ContainsHeader(S_A, N_B));
+    NEXT;
+
+  OPCODE(kEqualHeader):
+    memo(i_.EqualHeader(S_A, S_B));
+    NEXT;
+
+  OPCODE(kExistsHeader):
+    memo(i_.ExistsHeader(S_A));
+    NEXT;
+
+  OPCODE(kGreaterThanHeader):
+    memo(i_.GreaterThanHeader(S_A, OPERATION.b));
+    NEXT;
+
+  OPCODE(kGreaterThanAfterHeader):
+    memo(i_.GreaterThanAfterHeader(S_A, N_B, OPERATION.c));
+    NEXT;
+
+  OPCODE(kLessThanHeader):
+    memo(i_.LessThanHeader(S_A, OPERATION.b));
+    NEXT;
+
+  OPCODE(kLessThanAfterHeader):
+    memo(i_.LessThanAfterHeader(S_A, N_B, OPERATION.c));
+    NEXT;
+
+  OPCODE(kNotEqualHeader):
+    memo(i_.NotEqualHeader(S_A, S_B));
+    NEXT;
+
+  OPCODE(kStartsWithHeader):
+    memo(i_.StartsWithHeader(S_A, N_B, OPERATION.c));
+    NEXT;
+
+  OPCODE(kContainsHeaderI):
+    memo(i_.ContainsHeaderI(S_A, N_B));
+    NEXT;
+
+  OPCODE(kEqualHeaderI):
+    memo(i_.EqualHeaderI(S_A, S_B));
+    NEXT;
+
+  OPCODE(kNotEqualHeaderI):
+    memo(i_.NotEqualHeaderI(S_A, S_B));
+    NEXT;
+
+  OPCODE(kContainsCookie):
+    memo(i_.ContainsCookie(S_A, N_B));
+    NEXT;
+
+  OPCODE(kEqualCookie):
+    memo(i_.EqualCookie(S_A, S_B));
+    NEXT;
+
+  OPCODE(kExistsCookie):
+    memo(i_.ExistsCookie(S_A));
+    NEXT;
+
+  OPCODE(kGreaterThanCookie):
+    memo(i_.GreaterThanCookie(S_A, OPERATION.b));
+    NEXT;
+
+  OPCODE(kGreaterThanAfterCookie):
+    memo(i_.GreaterThanAfterCookie(S_A, N_B, OPERATION.c));
+    NEXT;
+
+  OPCODE(kLessThanCookie):
+    memo(i_.LessThanCookie(S_A, OPERATION.b));
+    NEXT;
+
+  OPCODE(kLessThanAfterCookie):
+    memo(i_.LessThanAfterCookie(S_A, N_B, OPERATION.c));
+    NEXT;
+
+  OPCODE(kNotEqualCookie):
+    memo(i_.NotEqualCookie(S_A, S_B));
+    NEXT;
+
+  OPCODE(kExistsContainsQueryParameter):
+    memo(OPERATION.c == ExecutionMode::kOr
+        ? i_.ExistsQueryParameter(S_A) : i_.ContainsQueryParameter(S_A, N_B));
+    NEXT;
+
+  OPCODE(kExistsEqualQueryParameter):
+    memo(OPERATION.c == ExecutionMode::kOr
+        ? i_.ExistsQueryParameter(S_A) : i_.EqualQueryParameter(S_A, S_B));
+    NEXT;
+
+  OPCODE(kExistsGreaterThanQueryParameter):
+    memo(OPERATION.c == ExecutionMode::kOr
+        ? i_.ExistsQueryParameter(S_A) : i_.GreaterThanQueryParameter(S_A, OPERATION.b));
+    NEXT;
+
+  OPCODE(kExistsLessThanQueryParameter):
+    memo(OPERATION.c == ExecutionMode::kOr
+        ? i_.ExistsQueryParameter(S_A) : i_.LessThanQueryParameter(S_A, OPERATION.b));
+    NEXT;
+
+  OPCODE(kExistsStartsWithQueryParameter):
+    memo(OPERATION.c == ExecutionMode::kOr
+        ? i_.ExistsQueryParameter(S_A) : i_.StartsWithQueryParameter(S_A, N_B, 0));
+    NEXT;
+
+  OPCODE(kExistsContainsHeader):
+    memo(OPERATION.c == ExecutionMode::kOr
+        ? i_.ExistsHeader(S_A) : i_.ContainsHeader(S_A, N_B));
+    NEXT;
+
+  OPCODE(kExistsEqualHeader):
+    memo(OPERATION.c == ExecutionMode::kOr
+        ? i_.ExistsHeader(S_A) : i_.EqualHeader(S_A, S_B));
+    NEXT;
+
+  OPCODE(kExistsGreaterThanHeader):
+    memo(OPERATION.c == ExecutionMode::kOr
+        ? i_.ExistsHeader(S_A) : i_.GreaterThanHeader(S_A, OPERATION.b));
+    NEXT;
+
+  OPCODE(kExistsLessThanHeader):
+    memo(OPERATION.c == ExecutionMode::kOr
+        ? i_.ExistsHeader(S_A) : i_.LessThanHeader(S_A, OPERATION.b));
+    NEXT;
+
+  OPCODE(kExistsStartsWithHeader):
+    memo(OPERATION.c == ExecutionMode::kOr
+        ? i_.ExistsHeader(S_A) : i_.StartsWithHeader(S_A, N_B, 0));
+    NEXT;
+
+  OPCODE(kExistsContainsCookie):
+    memo(OPERATION.c == ExecutionMode::kOr
+        ? i_.ExistsCookie(S_A) : i_.ContainsCookie(S_A, N_B));
+    NEXT;
+
+  OPCODE(kExistsEqualCookie):
+    memo(OPERATION.c == ExecutionMode::kOr
+        ? i_.ExistsCookie(S_A) : i_.EqualCookie(S_A, S_B));
+    NEXT;
+
+  OPCODE(kExistsGreaterThanCookie):
+    memo(OPERATION.c == ExecutionMode::kOr
+        ? i_.ExistsCookie(S_A) : i_.GreaterThanCookie(S_A, OPERATION.b));
+    NEXT;
+
+  OPCODE(kExistsLessThanCookie):
+    memo(OPERATION.c == ExecutionMode::kOr
+        ? i_.ExistsCookie(S_A) : i_.LessThanCookie(S_A, OPERATION.b));
+    NEXT;
+
+  /*
+   * implementations able to scan answer the whole automaton at once, the
+   * others are asked about this one needle.
+   */
+  OPCODE(kContainsManyDomain):
+    {
+      const Automaton a(P_B);
+      Found f(*this);
+      if (i_.ContainsManyDomain(a, f)) {
+        scanned(f);
+      } else {
+        const char * const n = a.needle(OPERATION.c);
+        memo(i_.ContainsDomain(n, strlen(n)));
+      }
+    }
+    NEXT;
+
+  OPCODE(kContainsManyPath):
+    {
+      const Automaton a(P_B);
+      Found f(*this);
+      if (i_.ContainsManyPath(a, f)) {
+        scanned(f);
+      } else {
+        const char * const n = a.needle(OPERATION.c);
+        memo(i_.ContainsPath(n, strlen(n)));
+      }
+    }
+    NEXT;
+
+  OPCODE(kContainsManyQueryParameter):
+    {
+      const Automaton a(P_B);
+      Found f(*this);
+      if (i_.ContainsManyQueryParameter(S_A, a, f)) {
+        scanned(f);
+      } else {
+        memo(i_.ContainsQueryParameter(S_A, a.needle(OPERATION.c)));
+      }
+    }
+    NEXT;
+
+  OPCODE(kContainsManyHeader):
+    {
+      const Automaton a(P_B);
+      Found f(*this);
+      if (i_.ContainsManyHeader(S_A, a, f)) {
+        scanned(f);
+      } else {
+        memo(i_.ContainsHeader(S_A, a.needle(OPERATION.c)));
+      }
+    }
+    NEXT;
+
+  OPCODE(kContainsManyCookie):
+    {
+      const Automaton a(P_B);
+      Found f(*this);
+      if (i_.ContainsManyCookie(S_A, a, f)) {
+        scanned(f);
+      } else {
+        memo(i_.ContainsCookie(S_A, a.needle(OPERATION.c)));
+      }
+    }
+    NEXT;
+
+  OPCODE(kEqualDomainSet):
+    {
+      const HashSet s(P_A);
+      bool r = false;
+      if ( ! i_.EqualDomainSet(s, r)) {
+        for (uint32_t i = 0; ! r && i < s.capacity(); ++i) {
+          const char * const k = s.key(i);
+          r = k != NULL && i_.EqualDomain(k, s.slot(i)[2]);
+        }
+      }
+      memo(r);
+    }
+    NEXT;
+
+  OPCODE(kEqualPathSet):
+    {
+      const HashSet s(P_A);
+      bool r = false;
+      if ( ! i_.EqualPathSet(s, r)) {
+        for (uint32_t i = 0; ! r && i < s.capacity(); ++i) {
+          const char * const k = s.key(i);
+          r = k != NULL && i_.EqualPath(k, s.slot(i)[2]);
+        }
+      }
+      memo(r);
+    }
+    NEXT;
+
+  OPCODE(kMatches):
+    matches_ = reinterpret_cast< const uint32_t * >(P_A);
+    registers_.r = matches_[0] > 0;
+    NEXT;
+
+#ifndef USE_COMPUTED_GOTO
+  case Opcodes::kUpperBound: ASSERT(false); return false; //unrecheable
+  default: ASSERT(false); return false; //unrecheable
+  }
+#endif
 }
 
 template < class I >
 void VM< I >::print(void) const {
-  std::cout << std::hex << registers_.op << " "
-    << registers_.a << " " << registers_.b << " "
-    << registers_.c << " " "\n";
+  std::cout << std::hex << OPERATION.op << " "
+    << OPERATION.a << " " << OPERATION.b << " "
+    << OPERATION.c << " " "\n";
 }
 
 template < class I >
@@ -409,9 +595,17 @@ const int VM< I >::kStackSize = 16;
 } //end of filters namespace
 } //end of http namespace
 
+#undef OPERATION
+#undef S_A
+#undef S_B
 #undef P_A
 #undef P_B
+#undef OPERATION
 #undef P_AB
 #undef P_BA
+#undef N_A
+#undef N_B
+#undef OPCODE
+#undef NEXT
 
 #endif //VM_IMPL_H
@@ -8,6 +8,8 @@
 #include <iostream>
 #include <sstream>
 
+#include "automaton.h"
+#include "hash-set.h"
 #include "vm-printer.h"
 
 namespace http {
@@ -17,6 +19,13 @@ void Printer::print(const Code & co, const Memory & m) const {
   print(co, m, std::cout);
 }
 
+void Printer::print(const CompactCode & co, const Memory & m,
+    std::ostream & o) const {
+  std::vector< uint32_t > d(co.size() * kSize);
+  co.decode(d.data());
+  print(Code(d.data(), d.size()), m, o);
+}
+
 void Printer::print(const Code & co, const Memory & m,
     std::ostream & o) const {
 
@@ -83,6 +92,11 @@ void Printer::print(const Code & co, const Memory & m,
       }
     }
 
+    if (op == Opcodes::kJump || op == Opcodes::kJumpIfTrue
+        || op == Opcodes::kJumpIfFalse) {
+      comments << ( ! comments.str().empty() ? ", " : "") << " to " << a;
+    }
+
     if (it2 != END2 && it2->first == i) {
       ASSERT(op == Opcodes::kExecute
           || op == Opcodes::kExecuteSingle);
@@ -101,16 +115,32 @@ void Printer::print(const Code & co, const Memory & m,
       case Opcodes::kContainsCookie:
       case Opcodes::kContainsDomain:
       case Opcodes::kContainsHeader:
+      case Opcodes::kContainsHeaderI:
       case Opcodes::kContainsPath:
       case Opcodes::kContainsQueryParameter:
       case Opcodes::kEqualCookie:
       case Opcodes::kEqualDomain:
       case Opcodes::kEqualHeader:
+      case Opcodes::kEqualHeaderI:
       case Opcodes::kEqualPath:
       case Opcodes::kEqualQueryParameter:
       case Opcodes::kExistsCookie:
       case Opcodes::kExistsHeader:
       case Opcodes::kExistsQueryParameter:
+      case Opcodes::kExistsContainsQueryParameter:
+      case Opcodes::kExistsEqualQueryParameter:
+      case Opcodes::kExistsGreaterThanQueryParameter:
+      case Opcodes::kExistsLessThanQueryParameter:
+      case Opcodes::kExistsStartsWithQueryParameter:
+      case Opcodes::kExistsContainsHeader:
+      case Opcodes::kExistsEqualHeader:
+      case Opcodes::kExistsGreaterThanHeader:
+      case Opcodes::kExistsLessThanHeader:
+      case Opcodes::kExistsStartsWithHeader:
+      case Opcodes::kExistsContainsCookie:
+      case Opcodes::kExistsEqualCookie:
+      case Opcodes::kExistsGreaterThanCookie:
+      case Opcodes::kExistsLessThanCookie:
       case Opcodes::kGreaterThanAfterCookie:
       case Opcodes::kGreaterThanAfterHeader:
       case Opcodes::kGreaterThanAfterQueryParameter:
@@ -129,6 +159,7 @@ void Printer::print(const Code & co, const Memory & m,
       case Opcodes::kNotEqualPath:
       case Opcodes::kNotEqualCookie:
       case Opcodes::kNotEqualHeader:
+      case Opcodes::kNotEqualHeaderI:
       case Opcodes::kNotEqualQueryParameter:
       case Opcodes::kPrintDebug:
       case Opcodes::kPrintError:
@@ -136,6 +167,9 @@ void Printer::print(const Code & co, const Memory & m,
       case Opcodes::kStartsWithHeader:
       case Opcodes::kStartsWithPath:
       case Opcodes::kStartsWithQueryParameter:
+      case Opcodes::kContainsManyQueryParameter:
+      case Opcodes::kContainsManyHeader:
+      case Opcodes::kContainsManyCookie:
         if (a != 0) {
           ASSERT(a < m.size);
           o << " -> \"" << m.t + a << "\"\n";
@@ -149,10 +183,20 @@ void Printer::print(const Code & co, const Memory & m,
     switch (op) {
       case Opcodes::kContainsCookie:
       case Opcodes::kContainsHeader:
+      case Opcodes::kContainsHeaderI:
       case Opcodes::kContainsQueryParameter:
       case Opcodes::kEqualCookie:
       case Opcodes::kEqualHeader:
+      case Opcodes::kEqualHeaderI:
       case Opcodes::kEqualQueryParameter:
+      case Opcodes::kExistsContainsQueryParameter:
+      case Opcodes::kExistsEqualQueryParameter:
+      case Opcodes::kExistsStartsWithQueryParameter:
+      case Opcodes::kExistsContainsHeader:
+      case Opcodes::kExistsEqualHeader:
+      case Opcodes::kExistsStartsWithHeader:
+      case Opcodes::kExistsContainsCookie:
+      case Opcodes::kExistsEqualCookie:
       case Opcodes::kGreaterThanAfterCookie:
       case Opcodes::kGreaterThanAfterHeader:
       case Opcodes::kGreaterThanAfterQueryParameter:
@@ -162,6 +206,7 @@ void Printer::print(const Code & co, const Memory & m,
       case Opcodes::kLessThanQueryParameter:
       case Opcodes::kNotEqualCookie:
       case Opcodes::kNotEqualHeader:
+      case Opcodes::kNotEqualHeaderI:
       case Opcodes::kNotEqualQueryParameter:
       case Opcodes::kPrintDebug:
       case Opcodes::kPrintError:
@@ -175,6 +220,27 @@ void Printer::print(const Code & co, const Memory & m,
         }
         break;
 
+      case Opcodes::kContainsManyDomain:
+      case Opcodes::kContainsManyPath:
+      case Opcodes::kContainsManyQueryParameter:
+      case Opcodes::kContainsManyHeader:
+      case Opcodes::kContainsManyCookie:
+        ASSERT(b < m.size);
+        o << " -> \"" << Automaton(m.t + b).needle(c) << "\"\n";
+        break;
+
+      case Opcodes::kEqualDomainSet:
+      case Opcodes::kEqualPathSet:
+        ASSERT(a < m.size);
+        o << " -> " << HashSet(m.t + a).size() << " strings" "\n";
+        break;
+
+      case Opcodes::kMatches:
+        ASSERT(a < m.size);
+        o << " -> " << *reinterpret_cast< const uint32_t * >(m.t + a)
+          << " entries" "\n";
+        break;
+
       default:
         break;
     }
@@ -207,6 +273,8 @@ const char * Printer::opcode(Opcodes::OPCODES op) {
     return "kOr"; break;
   case Opcodes::kNot:
     return "kNot"; break;
+  case Opcodes::kFlip:
+    return "kFlip"; break;
 
   case Opcodes::kFalse:
     return "kFalse"; break;
@@ -296,6 +364,68 @@ const char * Printer::opcode(Opcodes::OPCODES op) {
   case Opcodes::kNotEqualCookie:
     return "kNotEqualCookie"; break;
 
+  case Opcodes::kExistsContainsQueryParameter:
+    return "kExistsContainsQueryParameter"; break;
+  case Opcodes::kExistsEqualQueryParameter:
+    return "kExistsEqualQueryParameter"; break;
+  case Opcodes::kExistsGreaterThanQueryParameter:
+    return "kExistsGreaterThanQueryParameter"; break;
+  case Opcodes::kExistsLessThanQueryParameter:
+    return "kExistsLessThanQueryParameter"; break;
+  case Opcodes::kExistsStartsWithQueryParameter:
+    return "kExistsStartsWithQueryParameter"; break;
+  case Opcodes::kExistsContainsHeader:
+    return "kExistsContainsHeader"; break;
+  case Opcodes::kExistsEqualHeader:
+    return "kExistsEqualHeader"; break;
+  case Opcodes::kExistsGreaterThanHeader:
+    return "kExistsGreaterThanHeader"; break;
+  case Opcodes::kExistsLessThanHeader:
+    return "kExistsLessThanHeader"; break;
+  case Opcodes::kExistsStartsWithHeader:
+    return "kExistsStartsWithHeader"; break;
+  case Opcodes::kExistsContainsCookie:
+    return "kExistsContainsCookie"; break;
+  case Opcodes::kExistsEqualCookie:
+    return "kExistsEqualCookie"; break;
+  case Opcodes::kExistsGreaterThanCookie:
+    return "kExistsGreaterThanCookie"; break;
+  case Opcodes::kExistsLessThanCookie:
+    return "kExistsLessThanCookie"; break;
+
+  case Opcodes::kJump:
+    return "kJump"; break;
+  case Opcodes::kJumpIfTrue:
+    return "kJumpIfTrue"; break;
+  case Opcodes::kJumpIfFalse:
+    return "kJumpIfFalse"; break;
+
+  case Opcodes::kContainsManyDomain:
+    return "kContainsManyDomain"; break;
+  case Opcodes::kContainsManyPath:
+    return "kContainsManyPath"; break;
+  case Opcodes::kContainsManyQueryParameter:
+    return "kContainsManyQueryParameter"; break;
+  case Opcodes::kContainsManyHeader:
+    return "kContainsManyHeader"; break;
+  case Opcodes::kContainsManyCookie:
+    return "kContainsManyCookie"; break;
+
+  case Opcodes::kEqualDomainSet:
+    return "kEqualDomainSet"; break;
+  case Opcodes::kEqualPathSet:
+    return "kEqualPathSet"; break;
+
+  case Opcodes::kMatches:
+    return "kMatches"; break;
+
+  case Opcodes::kContainsHeaderI:
+    return "kContainsHeaderI"; break;
+  case Opcodes::kEqualHeaderI:
+    return "kEqualHeaderI"; break;
+  case Opcodes::kNotEqualHeaderI:
+    return "kNotEqualHeaderI"; break;
+
   case Opcodes::kUpperBound:
     return "kUpperBound"; break;
 
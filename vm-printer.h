@@ -21,6 +21,9 @@ struct Printer {
   void print(const Code &, const Memory &,
       std::ostream &) const;
 
+  void print(const CompactCode &, const Memory &,
+      std::ostream &) const;
+
   static const char * opcode(Opcodes::OPCODES);
 };
 } //end of vm namespace
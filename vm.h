@@ -8,6 +8,7 @@
 #define VM_H
 
 #include <algorithm>
+#include <new>
 #include <vector>
 #include <string>
 
@@ -16,11 +17,29 @@
 #include "my-assert.h"
 
 #include "array.h"
+#include "automaton.h"
 #include "bitmap.h"
+#include "hash-set.h"
+#include "needle.h"
 #include "opcodes.h"
+#include "perfect-hash.h"
+#include "profile.h"
+#include "program.h"
+#include "requirements.h"
+
+/*
+ * GCC and Clang support labels as values, which allows the VM to jump
+ * straight from one instruction handler to the next one instead of going
+ * through a single indirect jump. Define DISABLE_COMPUTED_GOTO to fall back
+ * to the portable switch.
+ */
+#if defined(__GNUC__) && ! defined(DISABLE_COMPUTED_GOTO)
+#define USE_COMPUTED_GOTO
+#endif
 
 namespace http {
 namespace filters {
+typedef std::vector< uint32_t > Offsets;
 
 struct Instruction {
   uint32_t op;
@@ -39,7 +58,8 @@ struct Instructions {
   uint32_t size_;
 };
 
-struct Registers : Instruction {
+struct Registers {
+  const Operation * operation;
   uint32_t pc;
   uint32_t count;
 
@@ -47,15 +67,10 @@ struct Registers : Instruction {
   bool n;
   uint8_t mode;
 
-  Registers(void) : Instruction(0, 0, 0, 0),
+  Registers(void) : operation(&Program::Return),
     pc(0), count(0), r(true), n(false), mode(0) { }
 };
 
-typedef util::Array< const uint32_t > Code;
-typedef util::Array< const char > Memory;
-
-static const int kSize = 4;
-
 template < class I >
 struct VM {
   static const int kBits = 2;
@@ -65,28 +80,92 @@ struct VM {
   typedef std::vector< Registers > Stack;
 
   Registers registers_;
+  //owned only when the VM decodes the program itself.
+  Program * const decoded_;
+  const Program & p_;
+  //the Memory of p_, what P_A and P_B point into.
+  const char * const memory_;
+  //two bits per predicate id: cached, then value.
   Bitmap bitmap_;
-  Bit bit_;
-  const Code c_;
-  const Memory m_;
 
   Stack stack_;
   I i_;
 
+  //per instruction, empty unless profiling.
+  Counters counters_;
+  //the entries of the last kMatches.
+  const uint32_t * matches_;
+
+  ~VM() {
+    delete decoded_;
+  }
+
   VM(const I & i, const Code & c, const Memory & m) :
-    bitmap_(c.size * kBits, false), bit_(bitmap_.begin()),
-    c_(c), m_(m), i_(i) {
+    decoded_(new Program(c, m)), p_(*decoded_), memory_(p_.memory_),
+    bitmap_(p_.memos() * kBits, false), i_(i), matches_(NULL) {
+    registers_.mode = ExecutionMode::kNone;
+    stack_.reserve(kInitialStackSize);
+  }
+
+  VM(const I & i, const CompactCode & c, const Memory & m) :
+    decoded_(new Program(c, m)), p_(*decoded_), memory_(p_.memory_),
+    bitmap_(p_.memos() * kBits, false), i_(i), matches_(NULL) {
+    registers_.mode = ExecutionMode::kNone;
+    stack_.reserve(kInitialStackSize);
+  }
+
+  VM(const I & i, const Program & p) :
+    decoded_(NULL), p_(p), memory_(p_.memory_),
+    bitmap_(p_.memos() * kBits, false), i_(i), matches_(NULL) {
     registers_.mode = ExecutionMode::kNone;
     stack_.reserve(kInitialStackSize);
   }
 
   bool run(const uint32_t, const uint32_t j = 0);
 
-  inline void dispatch(void);
+  /*
+   * Runs every entry in order, one result bit per entry. Entries made of a
+   * single instruction already memoized are answered without running.
+   */
+  void runAll(const Offsets &, Bitmap &);
+
+  /*
+   * The same, once the implementation fetched what the entries read. When
+   * it can tell, entries needing a missing name are false without running.
+   */
+  void runAll(const Offsets &, Bitmap &, const Requirements &);
+
+  /*
+   * Runs a decision diagram, see Compiler::compileDiagram, one result bit
+   * per entry of the forest it was compiled from.
+   */
+  void runDiagram(const uint32_t, Bitmap &);
+
+  /*
+   * Gets the VM ready for a new transaction: registers, stack and memo are
+   * cleared in place and the implementation is replaced, nothing is freed
+   * or allocated.
+   */
+  inline void reset(const I & i) {
+    registers_ = Registers();
+    registers_.mode = ExecutionMode::kNone;
+    stack_.clear();
+    bitmap_.reset();
+    //implementations may hold references, so they are rebuilt in place.
+    i_.~I();
+    new (&i_) I(i);
+  }
+
+  /*
+   * Starts counting, per instruction, how many times each predicate is
+   * evaluated and how many times it is true. Counters survive reset.
+   */
+  inline void profile(void) { counters_.assign(p_.size(), Counter()); }
+
+  inline bool dispatch(void);
 
   inline void forceReturn(void) {
-    registers_.op = Opcodes::kReturn;
-    registers_.a = registers_.b = registers_.c = 0x0;
+    registers_.operation = &Program::Return;
   }
 
   inline const Registers & stackPush(void) {
@@ -101,23 +180,80 @@ struct VM {
     stack_.pop_back();
   }
 
-  inline void fetch(void) {
-    //load the instruction at once.
-    uint32_t * p = reinterpret_cast< uint32_t * >(&registers_);
-
-    const uint32_t * begin = c_ + (registers_.pc * kSize),
-          * end = begin + kSize;
-
-    //simple 1 instruction GOTO
-    while (begin[0] == Opcodes::kExecuteSingle) {
-      ASSERT(begin[1] != registers_.pc); //prevents infinite loop.
-      ASSERT(begin[1] < c_.size);
-      //TODO(dmorilha): fetch bit.
-      begin = c_ + (begin[1] * kSize);
-      end = begin + kSize;
+  //loads the next instruction, unless its result is already cached.
+  inline void next(void) {
+    while (true) {
+      ASSERT(registers_.mode > ExecutionMode::kNull);
+      ASSERT(registers_.mode < ExecutionMode::kUpperBound);
+
+      //checks previous operation
+
+      if (registers_.count == 0) {
+        forceReturn();
+
+      } else if (registers_.mode == ExecutionMode::kNone
+        || (registers_.mode == ExecutionMode::kAnd && registers_.r)
+        || (registers_.mode == ExecutionMode::kOr && ! registers_.r)) {
+
+        //checks the cache.
+        const uint32_t m = p_[registers_.pc].memo;
+        if (cached(m)) {
+          result(cachedValue(m));
+          step();
+          continue;
+        } else {
+          fetch();
+        }
+      } else {
+        forceReturn();
+      }
+
+      return;
     }
+  }
+
+  //answers an entry straight from the memo, when that is all it would do.
+  inline bool implied(const uint32_t o) {
+    if (o + 1 >= p_.size() || p_[o + 1].op != Opcodes::kReturn) {
+      return false;
+    }
+    const uint32_t m = p_[o].memo;
+    if ( ! cached(m)) {
+      return false;
+    }
+    result(cachedValue(m));
+    return true;
+  }
 
-    std::copy(begin, end, p);
+  //pops the stack after a kReturn, false when there is nothing left.
+  inline bool unwind(void) {
+    if (stack_.empty()) {
+      //TODO(dmorilha): investigate if this is a semantic fault.
+      return false;
+    }
+
+    const bool r = registers_.r;
+    stackPop();
+    result(r);
+
+    ASSERT(registers_.pc > 0);
+    ASSERT(registers_.pc < p_.size());
+
+    const Operation & b = p_[registers_.pc - 1];
+    if (b.op == Opcodes::kExecute
+        && (b.a == ExecutionMode::kOr
+        || b.a == ExecutionMode::kAnd)) {
+      store(b.memo, r);
+    }
+    return true;
+  }
+
+  inline void fetch(void) {
+    /*
+     * kExecuteSingle was already followed when the program was decoded, its
+     * copy of the kExecute shares the memo id as well.
+     */
+    registers_.operation = &p_[registers_.pc];
     step();
 
     //std::cerr << "NEXT" "\n";
@@ -128,15 +264,65 @@ struct VM {
     --registers_.count;
   }
 
-  inline void jumpBit(const uint32_t i) {
-    ASSERT(i < c_.size);
-    bit_ = bitmap_[i * kBits];
-    ASSERT(bit_ <= bitmap_.end());
+  inline bool cached(const uint32_t m) {
+    return m != Operation::kNoMemo && bitmap_[m * kBits];
+  }
+
+  inline bool cachedValue(const uint32_t m) {
+    ASSERT(m != Operation::kNoMemo);
+    return bitmap_[m * kBits + 1];
+  }
+
+  inline void store(const uint32_t m, const bool r) {
+    ASSERT(m != Operation::kNoMemo);
+    Bit b = bitmap_[m * kBits];
+    b = true;
+    ++b;
+    b = r;
+  }
+
+  //stores the result and caches it by predicate id.
+  inline void memo(const bool r) {
+    result(r);
+    store(registers_.operation->memo, r);
+    count(r);
+  }
+
+  inline void count(const bool r) {
+    if ( ! counters_.empty()) {
+      Counter & c = counters_[registers_.operation - &p_[0]];
+      ++c.executions;
+      c.trues += r;
+    }
   }
 
-  inline void incrementBit(void) {
-    ++bit_;
-    ASSERT(bit_ <= bitmap_.end());
+  //stores true for every needle an automaton finds.
+  struct Found {
+    VM & vm_;
+    const std::vector< uint32_t > & memos_;
+
+    Found(VM & v) : vm_(v),
+      memos_(v.p_.scans_[v.registers_.operation->scan]) { }
+
+    inline void operator () (const uint32_t i) {
+      ASSERT(i < memos_.size());
+      if (memos_[i] != Operation::kNoMemo) {
+        vm_.store(memos_[i], true);
+      }
+    }
+  };
+
+  //after a scan, whatever was not found is false.
+  inline void scanned(const Found & f) {
+    const std::vector< uint32_t > & m = f.memos_;
+    for (uint32_t i = 0; i < m.size(); ++i) {
+      if (m[i] != Operation::kNoMemo && ! cached(m[i])) {
+        store(m[i], false);
+      }
+    }
+    const bool r = cachedValue(registers_.operation->memo);
+    result(r);
+    count(r);
   }
 
   inline void print(void) const;
@@ -150,6 +336,11 @@ struct VM {
     }
     registers_.r = r;
   }
+
+private:
+  //the decoded Program is owned, a VM is never copied.
+  VM(const VM &);
+  VM & operator = (const VM &);
 };
 
 template < class I >
@@ -158,24 +349,32 @@ struct VMProxy {
   typedef std::vector< Entry > Entries;
 
   VM< I > vm_;
-  Entries entries_;
+  //the entries by name, in any order, see PerfectHash.
+  std::vector< uint32_t > entries_;
 
-  //TODO(dmorilha): need to make sure entries are sorted.
   VMProxy(const I & i, const Code & c, const Memory & m,
-      const Entries & e = Entries()) : vm_(i, c, m), entries_(e) { }
+      const Entries & e = Entries()) : vm_(i, c, m) {
+    PerfectHash::Build(e, entries_);
+  }
+
+  VMProxy(const I & i, const Program & p,
+      const Entries & e = Entries()) : vm_(i, p) {
+    PerfectHash::Build(e, entries_);
+  }
+
+  inline void reset(const I & i) { vm_.reset(i); }
 
   bool run(const uint32_t i, const uint32_t j = 0) {
     return vm_.run(i, j);
   }
 
   bool run(const std::string & k, const uint32_t j = 0) {
-    const Entries::const_iterator i = std::lower_bound(entries_.begin(),
-        entries_.end(), std::make_pair(k, 0));
-    if (i->first != k) {
+    uint32_t i = 0;
+    if ( ! PerfectHash(&entries_[0]).find(k.data(), k.size(), i)) {
       //Entry does not exists
       return false;
     }
-    return vm_.run(i->second, j);
+    return vm_.run(i, j);
   }
 };
 